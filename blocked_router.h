@@ -0,0 +1,121 @@
+#pragma once
+
+#include "graph.h"
+#include "min_plus_kernels.h"
+#include "router.h"
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <type_traits>
+#include <vector>
+
+namespace Graph {
+
+  // Floyd-Warshall over BLOCK_SIZE x BLOCK_SIZE tiles of the same flat table.
+  // Each round relaxes through one diagonal block: first the diagonal tile,
+  // then its row and column tiles, then all the remaining tiles. Tiles of a
+  // phase do not depend on each other and are relaxed in parallel. Rows of
+  // double weights go through the vectorized min-plus kernel.
+  template <typename Weight>
+  class BlockedFloydWarshallRouter : public FloydWarshallRouter<Weight> {
+  private:
+    using typename Router<Weight>::Graph;
+    using typename FloydWarshallRouter<Weight>::InitializeOnly;
+    using FloydWarshallRouter<Weight>::UNREACHABLE;
+
+  public:
+    BlockedFloydWarshallRouter(const Graph& graph, size_t thread_count);
+
+  private:
+    static constexpr size_t BLOCK_SIZE = 64;
+
+    size_t vertex_count_;
+    size_t block_count_;
+
+    size_t BlockBegin(size_t block) const {
+      return block * BLOCK_SIZE;
+    }
+    size_t BlockEnd(size_t block) const {
+      return std::min(vertex_count_, (block + 1) * BLOCK_SIZE);
+    }
+
+    void RelaxRow(Weight weight_from,
+                  const Weight* through_weights, const CompactId* through_prev_edges,
+                  Weight* weights, CompactId* prev_edges, size_t count) {
+      if constexpr (std::is_same_v<Weight, double>) {
+        RelaxMinPlusRow(weight_from, through_weights, through_prev_edges, weights, prev_edges, count);
+      } else {
+        for (size_t j = 0; j < count; ++j) {
+          if (through_weights[j] == UNREACHABLE) {
+            continue;
+          }
+          const Weight candidate_weight = weight_from + through_weights[j];
+          if (candidate_weight < weights[j]) {
+            weights[j] = candidate_weight;
+            prev_edges[j] = through_prev_edges[j];
+          }
+        }
+      }
+    }
+
+    void RelaxTile(size_t block_from, size_t block_to, size_t block_through) {
+      auto& routes = this->routes_internal_data_;
+      const size_t to_begin = BlockBegin(block_to);
+      const size_t to_count = BlockEnd(block_to) - to_begin;
+
+      for (VertexId vertex_through = BlockBegin(block_through); vertex_through < BlockEnd(block_through); ++vertex_through) {
+        const Weight* through_weights = routes.Weights(vertex_through) + to_begin;
+        const CompactId* through_prev_edges = routes.PrevEdges(vertex_through) + to_begin;
+
+        for (VertexId vertex_from = BlockBegin(block_from); vertex_from < BlockEnd(block_from); ++vertex_from) {
+          const Weight weight_from = routes.Weights(vertex_from)[vertex_through];
+          if (weight_from == UNREACHABLE) {
+            continue;
+          }
+          RelaxRow(weight_from, through_weights, through_prev_edges,
+                   routes.Weights(vertex_from) + to_begin, routes.PrevEdges(vertex_from) + to_begin, to_count);
+        }
+      }
+    }
+  };
+
+
+  template <typename Weight>
+  BlockedFloydWarshallRouter<Weight>::BlockedFloydWarshallRouter(const Graph& graph, size_t thread_count)
+      : FloydWarshallRouter<Weight>(graph, InitializeOnly{}),
+        vertex_count_(graph.GetVertexCount()),
+        block_count_((graph.GetVertexCount() + BLOCK_SIZE - 1) / BLOCK_SIZE)
+  {
+    ThreadPool pool{thread_count};
+
+    for (size_t block_through = 0; block_through < block_count_; ++block_through) {
+      RelaxTile(block_through, block_through, block_through);
+
+      std::vector<ThreadPool::Task> cross_tasks;
+      for (size_t block = 0; block < block_count_; ++block) {
+        if (block != block_through) {
+          cross_tasks.push_back([this, block, block_through](size_t) {
+            RelaxTile(block_through, block, block_through);
+            RelaxTile(block, block_through, block_through);
+          });
+        }
+      }
+      pool.Execute(std::move(cross_tasks));
+
+      std::vector<ThreadPool::Task> rest_tasks;
+      for (size_t block_from = 0; block_from < block_count_; ++block_from) {
+        if (block_from != block_through) {
+          rest_tasks.push_back([this, block_from, block_through](size_t) {
+            for (size_t block_to = 0; block_to < block_count_; ++block_to) {
+              if (block_to != block_through) {
+                RelaxTile(block_from, block_to, block_through);
+              }
+            }
+          });
+        }
+      }
+      pool.Execute(std::move(rest_tasks));
+    }
+  }
+
+}
@@ -0,0 +1,398 @@
+#pragma once
+
+#include "graph.h"
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace Graph {
+
+  // Contraction hierarchy for point-to-point queries without an all-pairs table.
+  // Vertices are contracted one by one in order of rank; contracting v adds a
+  // shortcut u -> w for every path u -> v -> w that has no witness path of the
+  // same or smaller weight avoiding v. Arc ids below GetEdgeCount() are the
+  // graph edges themselves, the rest are shortcuts of two consecutive arcs.
+  template <typename Weight>
+  class ContractionHierarchy {
+  private:
+    using Graph = DirectedWeightedGraph<Weight>;
+
+  public:
+    using ExpandedRoute = std::vector<EdgeId>;
+
+    struct Arc {
+      CompactId from;
+      CompactId to;
+      Weight weight;
+    };
+
+    struct Shortcut {
+      CompactId first;
+      CompactId second;
+    };
+
+    struct Route {
+      Weight weight;
+      ExpandedRoute edges;
+    };
+
+    explicit ContractionHierarchy(const Graph& graph);
+    ContractionHierarchy(std::vector<CompactId> ranks, std::vector<Arc> arcs, std::vector<Shortcut> shortcuts);
+
+    std::optional<Route> FindRoute(VertexId from, VertexId to) const;
+
+    const std::vector<CompactId>& GetRanks() const { return ranks_; }
+    const std::vector<Arc>& GetArcs() const { return arcs_; }
+    const std::vector<Shortcut>& GetShortcuts() const { return shortcuts_; }
+    size_t GetEdgeCount() const { return arcs_.size() - shortcuts_.size(); }
+
+  private:
+    static constexpr CompactId NO_ARC = std::numeric_limits<CompactId>::max();
+    static constexpr Weight UNREACHABLE = std::numeric_limits<Weight>::has_infinity
+        ? std::numeric_limits<Weight>::infinity()
+        : std::numeric_limits<Weight>::max();
+    static constexpr size_t WITNESS_SETTLE_LIMIT = 500;
+
+    std::vector<CompactId> ranks_;
+    std::vector<Arc> arcs_;
+    std::vector<Shortcut> shortcuts_;
+
+    // Arcs leading up the hierarchy: by tail for the forward search and by
+    // head for the backward one, in compressed sparse row form.
+    std::vector<CompactId> up_offsets_;
+    std::vector<CompactId> up_arcs_;
+    std::vector<CompactId> down_offsets_;
+    std::vector<CompactId> down_arcs_;
+
+    struct SearchSpace {
+      std::vector<Weight> distances;
+      std::vector<CompactId> parent_arcs;
+      std::vector<CompactId> touched;
+
+      void Reset(size_t vertex_count) {
+        if (distances.size() != vertex_count) {
+          distances.assign(vertex_count, UNREACHABLE);
+          parent_arcs.assign(vertex_count, NO_ARC);
+          touched.clear();
+          return;
+        }
+        for (const CompactId vertex : touched) {
+          distances[vertex] = UNREACHABLE;
+          parent_arcs[vertex] = NO_ARC;
+        }
+        touched.clear();
+      }
+
+      bool Improve(CompactId vertex, Weight distance, CompactId parent_arc) {
+        if (distance >= distances[vertex]) {
+          return false;
+        }
+        if (distances[vertex] == UNREACHABLE) {
+          touched.push_back(vertex);
+        }
+        distances[vertex] = distance;
+        parent_arcs[vertex] = parent_arc;
+        return true;
+      }
+    };
+    mutable SearchSpace forward_;
+    mutable SearchSpace backward_;
+
+    void Contract(const Graph& graph);
+    void BuildSearchGraphs();
+    void UnpackArc(CompactId arc, ExpandedRoute& edges) const;
+  };
+
+
+  template <typename Weight>
+  ContractionHierarchy<Weight>::ContractionHierarchy(const Graph& graph) {
+    Contract(graph);
+    BuildSearchGraphs();
+  }
+
+  template <typename Weight>
+  ContractionHierarchy<Weight>::ContractionHierarchy(std::vector<CompactId> ranks, std::vector<Arc> arcs, std::vector<Shortcut> shortcuts)
+      : ranks_(std::move(ranks)),
+        arcs_(std::move(arcs)),
+        shortcuts_(std::move(shortcuts))
+  {
+    BuildSearchGraphs();
+  }
+
+  template <typename Weight>
+  void ContractionHierarchy<Weight>::Contract(const Graph& graph) {
+    const size_t vertex_count = graph.GetVertexCount();
+
+    struct Neighbour {
+      CompactId vertex;
+      Weight weight;
+      CompactId arc;
+    };
+    using Neighbours = std::vector<Neighbour>;
+    std::vector<Neighbours> out(vertex_count);
+    std::vector<Neighbours> in(vertex_count);
+
+    // Keeps only the lightest arc between a pair of vertices
+    auto add_neighbour = [](Neighbours& neighbours, Neighbour neighbour) {
+      auto it = std::find_if(std::begin(neighbours), std::end(neighbours),
+                             [&neighbour](const Neighbour& n) { return n.vertex == neighbour.vertex; });
+      if (it == std::end(neighbours)) {
+        neighbours.push_back(neighbour);
+      } else if (neighbour.weight < it->weight) {
+        *it = neighbour;
+      }
+    };
+    auto remove_neighbour = [](Neighbours& neighbours, CompactId vertex) {
+      neighbours.erase(std::remove_if(std::begin(neighbours), std::end(neighbours),
+                                      [vertex](const Neighbour& n) { return n.vertex == vertex; }),
+                       std::end(neighbours));
+    };
+
+    arcs_.reserve(graph.GetEdgeCount());
+    for (EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+      const auto edge = graph.GetEdge(edge_id);
+      const CompactId arc = arcs_.size();
+      arcs_.push_back({static_cast<CompactId>(edge.from), static_cast<CompactId>(edge.to), edge.weight});
+      if (edge.from != edge.to) {
+        add_neighbour(out[edge.from], {static_cast<CompactId>(edge.to), edge.weight, arc});
+        add_neighbour(in[edge.to], {static_cast<CompactId>(edge.from), edge.weight, arc});
+      }
+    }
+
+    struct ShortcutCandidate {
+      CompactId from;
+      CompactId to;
+      Weight weight;
+      Shortcut halves;
+    };
+
+    SearchSpace witness;
+    using QueueItem = std::pair<Weight, CompactId>;
+
+    // Shortcuts needed to bypass `vertex`, checked by bounded Dijkstra runs
+    // from each of its in-neighbours over the uncontracted graph
+    auto find_shortcuts = [&](CompactId vertex) {
+      std::vector<ShortcutCandidate> candidates;
+      if (out[vertex].empty()) {
+        return candidates;
+      }
+      Weight max_out_weight = 0;
+      for (const auto& to : out[vertex]) {
+        max_out_weight = std::max(max_out_weight, to.weight);
+      }
+
+      for (const auto& from : in[vertex]) {
+        const Weight limit = from.weight + max_out_weight;
+        witness.Reset(vertex_count);
+        witness.Improve(from.vertex, 0, NO_ARC);
+        std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>> queue;
+        queue.push({0, from.vertex});
+
+        for (size_t settled = 0; !queue.empty() && settled < WITNESS_SETTLE_LIMIT; ++settled) {
+          const auto [distance, current] = queue.top();
+          queue.pop();
+          if (distance > witness.distances[current]) {
+            continue;
+          }
+          if (distance > limit) {
+            break;
+          }
+          for (const auto& next : out[current]) {
+            if (next.vertex != vertex && witness.Improve(next.vertex, distance + next.weight, next.arc)) {
+              queue.push({distance + next.weight, next.vertex});
+            }
+          }
+        }
+
+        for (const auto& to : out[vertex]) {
+          const Weight weight = from.weight + to.weight;
+          if (to.vertex != from.vertex && weight < witness.distances[to.vertex]) {
+            candidates.push_back({from.vertex, to.vertex, weight, {from.arc, to.arc}});
+          }
+        }
+      }
+      return candidates;
+    };
+
+    std::vector<size_t> contracted_neighbours(vertex_count, 0);
+    auto priority = [&](CompactId vertex, size_t shortcut_count) {
+      return static_cast<long long>(shortcut_count)
+          - static_cast<long long>(in[vertex].size() + out[vertex].size())
+          + static_cast<long long>(contracted_neighbours[vertex]);
+    };
+
+    using PriorityItem = std::pair<long long, CompactId>;
+    std::priority_queue<PriorityItem, std::vector<PriorityItem>, std::greater<PriorityItem>> order;
+    for (CompactId vertex = 0; vertex < vertex_count; ++vertex) {
+      order.push({priority(vertex, find_shortcuts(vertex).size()), vertex});
+    }
+
+    ranks_.assign(vertex_count, 0);
+    CompactId next_rank = 0;
+    while (!order.empty()) {
+      const CompactId vertex = order.top().second;
+      order.pop();
+
+      // Priorities go stale as neighbours get contracted: recheck lazily
+      auto candidates = find_shortcuts(vertex);
+      const long long current_priority = priority(vertex, candidates.size());
+      if (!order.empty() && current_priority > order.top().first) {
+        order.push({current_priority, vertex});
+        continue;
+      }
+
+      for (const auto& candidate : candidates) {
+        const CompactId arc = arcs_.size();
+        arcs_.push_back({candidate.from, candidate.to, candidate.weight});
+        shortcuts_.push_back(candidate.halves);
+        add_neighbour(out[candidate.from], {candidate.to, candidate.weight, arc});
+        add_neighbour(in[candidate.to], {candidate.from, candidate.weight, arc});
+      }
+
+      for (const auto& from : in[vertex]) {
+        remove_neighbour(out[from.vertex], vertex);
+        ++contracted_neighbours[from.vertex];
+      }
+      for (const auto& to : out[vertex]) {
+        remove_neighbour(in[to.vertex], vertex);
+        ++contracted_neighbours[to.vertex];
+      }
+      Neighbours{}.swap(in[vertex]);
+      Neighbours{}.swap(out[vertex]);
+
+      ranks_[vertex] = next_rank++;
+    }
+  }
+
+  template <typename Weight>
+  void ContractionHierarchy<Weight>::BuildSearchGraphs() {
+    const size_t vertex_count = ranks_.size();
+    up_offsets_.assign(vertex_count + 1, 0);
+    down_offsets_.assign(vertex_count + 1, 0);
+
+    for (const auto& arc : arcs_) {
+      if (ranks_[arc.to] > ranks_[arc.from]) {
+        ++up_offsets_[arc.from + 1];
+      } else if (ranks_[arc.to] < ranks_[arc.from]) {
+        ++down_offsets_[arc.to + 1];
+      }
+    }
+    std::partial_sum(std::begin(up_offsets_), std::end(up_offsets_), std::begin(up_offsets_));
+    std::partial_sum(std::begin(down_offsets_), std::end(down_offsets_), std::begin(down_offsets_));
+
+    up_arcs_.resize(up_offsets_.back());
+    down_arcs_.resize(down_offsets_.back());
+    std::vector<CompactId> next_up{std::begin(up_offsets_), std::prev(std::end(up_offsets_))};
+    std::vector<CompactId> next_down{std::begin(down_offsets_), std::prev(std::end(down_offsets_))};
+    for (CompactId arc_id = 0; arc_id < arcs_.size(); ++arc_id) {
+      const auto& arc = arcs_[arc_id];
+      if (ranks_[arc.to] > ranks_[arc.from]) {
+        up_arcs_[next_up[arc.from]++] = arc_id;
+      } else if (ranks_[arc.to] < ranks_[arc.from]) {
+        down_arcs_[next_down[arc.to]++] = arc_id;
+      }
+    }
+  }
+
+  template <typename Weight>
+  std::optional<typename ContractionHierarchy<Weight>::Route> ContractionHierarchy<Weight>::FindRoute(VertexId from, VertexId to) const {
+    const size_t vertex_count = ranks_.size();
+    forward_.Reset(vertex_count);
+    backward_.Reset(vertex_count);
+
+    using QueueItem = std::pair<Weight, CompactId>;
+    using Queue = std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>>;
+    Queue forward_queue;
+    Queue backward_queue;
+    forward_.Improve(from, 0, NO_ARC);
+    forward_queue.push({0, static_cast<CompactId>(from)});
+    backward_.Improve(to, 0, NO_ARC);
+    backward_queue.push({0, static_cast<CompactId>(to)});
+
+    Weight best_weight = UNREACHABLE;
+    CompactId meeting_vertex = NO_ARC;
+
+    auto step = [&](Queue& queue, SearchSpace& space, const SearchSpace& other_space,
+                    const std::vector<CompactId>& offsets, const std::vector<CompactId>& search_arcs, bool forward) {
+      const auto [distance, vertex] = queue.top();
+      queue.pop();
+      if (distance > space.distances[vertex]) {
+        return;
+      }
+      if (other_space.distances[vertex] != UNREACHABLE && distance + other_space.distances[vertex] < best_weight) {
+        best_weight = distance + other_space.distances[vertex];
+        meeting_vertex = vertex;
+      }
+      for (CompactId i = offsets[vertex]; i < offsets[vertex + 1]; ++i) {
+        const CompactId arc_id = search_arcs[i];
+        const auto& arc = arcs_[arc_id];
+        const CompactId next = forward ? arc.to : arc.from;
+        if (space.Improve(next, distance + arc.weight, arc_id)) {
+          queue.push({distance + arc.weight, next});
+        }
+      }
+    };
+
+    while (true) {
+      const bool forward_open = !forward_queue.empty() && forward_queue.top().first < best_weight;
+      const bool backward_open = !backward_queue.empty() && backward_queue.top().first < best_weight;
+      if (!forward_open && !backward_open) {
+        break;
+      }
+      if (forward_open && (!backward_open || forward_queue.top().first <= backward_queue.top().first)) {
+        step(forward_queue, forward_, backward_, up_offsets_, up_arcs_, true);
+      } else {
+        step(backward_queue, backward_, forward_, down_offsets_, down_arcs_, false);
+      }
+    }
+
+    if (meeting_vertex == NO_ARC) {
+      return std::nullopt;
+    }
+
+    std::vector<CompactId> path;
+    for (CompactId vertex = meeting_vertex; forward_.parent_arcs[vertex] != NO_ARC; vertex = arcs_[forward_.parent_arcs[vertex]].from) {
+      path.push_back(forward_.parent_arcs[vertex]);
+    }
+    std::reverse(std::begin(path), std::end(path));
+    for (CompactId vertex = meeting_vertex; backward_.parent_arcs[vertex] != NO_ARC; vertex = arcs_[backward_.parent_arcs[vertex]].to) {
+      path.push_back(backward_.parent_arcs[vertex]);
+    }
+
+    Route route{0, {}};
+    for (const CompactId arc : path) {
+      UnpackArc(arc, route.edges);
+    }
+    // Summed edge by edge from the source, as a plain Dijkstra run would do
+    for (const EdgeId edge : route.edges) {
+      route.weight += arcs_[edge].weight;
+    }
+    return route;
+  }
+
+  template <typename Weight>
+  void ContractionHierarchy<Weight>::UnpackArc(CompactId arc, ExpandedRoute& edges) const {
+    const size_t edge_count = GetEdgeCount();
+    std::vector<CompactId> stack = {arc};
+    while (!stack.empty()) {
+      const CompactId current = stack.back();
+      stack.pop_back();
+      if (current < edge_count) {
+        edges.push_back(current);
+      } else {
+        const auto& shortcut = shortcuts_[current - edge_count];
+        stack.push_back(shortcut.second);
+        stack.push_back(shortcut.first);
+      }
+    }
+  }
+
+}
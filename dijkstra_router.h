@@ -0,0 +1,76 @@
+#pragma once
+
+#include "graph.h"
+#include "router_interface.h"
+
+#include <cassert>
+#include <functional>
+#include <optional>
+#include <queue>
+#include <utility>
+#include <vector>
+
+namespace Graph {
+
+  // Computes single-source shortest path trees on demand instead of the
+  // all-pairs table, one Dijkstra run per source. Route weights match
+  // Floyd-Warshall; among routes of equal weight the one kept is the first
+  // found, which need not be the one Floyd-Warshall keeps.
+  template <typename Weight>
+  class DijkstraRouter : public Router<Weight> {
+  private:
+    using typename Router<Weight>::Graph;
+
+  public:
+    using typename Router<Weight>::RouteTree;
+
+    DijkstraRouter(const Graph& graph);
+
+    RouteTree BuildRouteTree(VertexId from) const override;
+
+  private:
+    using RouteInternalData = typename Router<Weight>::RouteTreeNode;
+  };
+
+
+  template <typename Weight>
+  DijkstraRouter<Weight>::DijkstraRouter(const Graph& graph)
+      : Router<Weight>(graph)
+  {
+  }
+
+  template <typename Weight>
+  typename DijkstraRouter<Weight>::RouteTree DijkstraRouter<Weight>::BuildRouteTree(VertexId from) const {
+    using QueueItem = std::pair<Weight, VertexId>;
+    std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>> queue;
+    const Graph& graph = this->graph_;
+
+    RouteTree tree(graph.GetVertexCount());
+    tree[from] = RouteInternalData{0, std::nullopt};
+    queue.push({0, from});
+
+    while (!queue.empty()) {
+      const auto [weight, vertex] = queue.top();
+      queue.pop();
+      if (weight > tree[vertex]->weight) {
+        continue;
+      }
+
+      const auto arcs = graph.GetIncidentArcs(vertex);
+      for (CompactId arc = arcs.begin; arc < arcs.end; ++arc) {
+        const Weight edge_weight = graph.GetArcWeight(arc);
+        assert(edge_weight >= 0);
+        const Weight candidate_weight = weight + edge_weight;
+        const VertexId to = graph.GetArcTarget(arc);
+        auto& route_internal_data = tree[to];
+        if (!route_internal_data || candidate_weight < route_internal_data->weight) {
+          route_internal_data = RouteInternalData{candidate_weight, graph.GetArcEdge(arc)};
+          queue.push({candidate_weight, to});
+        }
+      }
+    }
+
+    return tree;
+  }
+
+}
@@ -0,0 +1,268 @@
+#include "flat_base.h"
+
+#include "route_tree_codec.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+constexpr size_t SECTION_ALIGNMENT = 8;
+
+uint64_t HashName(string_view name) {
+  uint64_t hash = 14695981039346656037ull;
+  for (const char c : name) {
+    hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+  }
+  return hash;
+}
+
+size_t IndexSize(size_t item_count) {
+  size_t size = 1;
+  while (size < 2 * item_count) {
+    size *= 2;
+  }
+  return size;
+}
+
+template <typename T>
+void AppendItems(string& section, const vector<T>& items) {
+  section.append(reinterpret_cast<const char*>(items.data()), items.size() * sizeof(T));
+}
+
+class StringTable {
+public:
+  FlatBase::StringRef Add(const string& value) {
+    if (const auto it = refs_.find(value); it != refs_.end()) {
+      return it->second;
+    }
+    const FlatBase::StringRef ref{static_cast<uint32_t>(data_.size()), static_cast<uint32_t>(value.size())};
+    data_ += value;
+    refs_.emplace(value, ref);
+    return ref;
+  }
+
+  const string& Data() const { return data_; }
+
+private:
+  string data_;
+  unordered_map<string, FlatBase::StringRef> refs_;
+};
+
+// Slot of every name: its id plus one at the first free position after the
+// name's hash
+vector<uint32_t> BuildIndex(const vector<string>& names) {
+  vector<uint32_t> index(IndexSize(names.size()), 0);
+  const size_t mask = index.size() - 1;
+  for (size_t id = 0; id < names.size(); ++id) {
+    size_t slot = HashName(names[id]) & mask;
+    while (index[slot]) {
+      slot = (slot + 1) & mask;
+    }
+    index[slot] = id + 1;
+  }
+  return index;
+}
+
+}
+
+void FlatBase::Write(const TransportGuide::TransportCatalog& base, size_t vertex_count,
+                     const RouteTreeSource& route_trees, ostream& out) {
+  const auto& router = base.router();
+  if (router.settings().routing_mode() != TransportGuide::ALL_PAIRS) {
+    throw invalid_argument("flat base format supports all_pairs routing only");
+  }
+
+  StringTable strings;
+  string sections[SECTION_COUNT];
+
+  const Settings settings{router.settings().bus_wait_time(), 0, router.settings().bus_velocity()};
+  sections[SETTINGS].assign(reinterpret_cast<const char*>(&settings), sizeof(settings));
+
+  vector<Stop> stops;
+  vector<string> stop_names;
+  stops.reserve(base.stops_size());
+  for (const auto& stop : base.stops()) {
+    stops.push_back({strings.Add(stop.name()), strings.Add(stop.response()), stop.request_id_offset(), 0});
+    stop_names.push_back(stop.name());
+  }
+  AppendItems(sections[STOPS], stops);
+  AppendItems(sections[STOP_INDEX], BuildIndex(stop_names));
+
+  vector<Bus> buses;
+  vector<string> bus_names;
+  buses.reserve(base.buses_size());
+  for (const auto& bus : base.buses()) {
+    buses.push_back({strings.Add(bus.name()), strings.Add(bus.response()), bus.request_id_offset(), 0});
+    bus_names.push_back(bus.name());
+  }
+  AppendItems(sections[BUSES], buses);
+  AppendItems(sections[BUS_INDEX], BuildIndex(bus_names));
+
+  vector<Activity> activities;
+  activities.reserve(router.wait_activity_size() + router.bus_activity_size());
+  for (const auto& wait : router.wait_activity()) {
+    activities.push_back({static_cast<double>(router.settings().bus_wait_time()), strings.Add(base.stops(wait.stop_id()).name()), ActivityKind::WAIT, 0, 0, 0});
+  }
+  for (const auto& bus : router.bus_activity()) {
+    activities.push_back({bus.time(), strings.Add(base.buses(bus.bus_id()).name()), ActivityKind::BUS, bus.span_count(), bus.start_stop_idx(), 0});
+  }
+  AppendItems(sections[ACTIVITIES], activities);
+  AppendItems(sections[EDGE_FROM], vector<uint32_t>{begin(router.edge_from()), end(router.edge_from())});
+
+  sections[STRINGS] = strings.Data();
+
+  // Route tables are streamed from route_trees after the other sections
+  uint64_t section_sizes[SECTION_COUNT];
+  for (size_t section = 0; section < SECTION_COUNT; ++section) {
+    section_sizes[section] = sections[section].size();
+  }
+  section_sizes[ROUTE_PREV_EDGES] = base.stops_size() * vertex_count * sizeof(uint32_t);
+  section_sizes[ROUTE_WEIGHTS] = base.stops_size() * base.stops_size() * sizeof(double);
+
+  Header header{};
+  memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version = VERSION;
+  header.vertex_count = vertex_count;
+  uint64_t offset = sizeof(Header);
+  for (size_t section = 0; section < SECTION_COUNT; ++section) {
+    offset = (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+    header.sections[section] = {offset, section_sizes[section]};
+    offset += section_sizes[section];
+  }
+
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  uint64_t written = sizeof(Header);
+  auto pad_to = [&](size_t section) {
+    const string padding(header.sections[section].offset - written, '\0');
+    out.write(padding.data(), padding.size());
+    written = header.sections[section].offset + section_sizes[section];
+  };
+  for (size_t section = 0; section < ROUTE_PREV_EDGES; ++section) {
+    pad_to(section);
+    out.write(sections[section].data(), sections[section].size());
+  }
+
+  pad_to(ROUTE_PREV_EDGES);
+  route_trees([&](const TransportGuide::RouteTree& tree) {
+    const auto prev_edges = RouteTreeCodec::DecodePrevEdges(tree);
+    out.write(reinterpret_cast<const char*>(prev_edges.data()), prev_edges.size() * sizeof(uint32_t));
+  });
+  pad_to(ROUTE_WEIGHTS);
+  route_trees([&](const TransportGuide::RouteTree& tree) {
+    const auto weights = RouteTreeCodec::DecodeWeights(tree);
+    out.write(reinterpret_cast<const char*>(weights.data()), weights.size() * sizeof(double));
+  });
+}
+
+bool FlatBase::IsFlatBase(const string& file_name) {
+  ifstream in_file(file_name, ios::binary);
+  char magic[sizeof(MAGIC)];
+  return in_file.read(magic, sizeof(magic)) && memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+}
+
+FlatBase::FlatBase(const string& file_name) {
+  const int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd < 0) {
+    throw runtime_error("cannot open base file " + file_name);
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || static_cast<size_t>(file_stat.st_size) < sizeof(Header)) {
+    close(fd);
+    throw runtime_error("invalid flat base file " + file_name);
+  }
+  size_ = file_stat.st_size;
+  void* data = mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) {
+    throw runtime_error("cannot map base file " + file_name);
+  }
+  data_ = static_cast<const char*>(data);
+  header_ = reinterpret_cast<const Header*>(data_);
+
+  bool valid = memcmp(header_->magic, MAGIC, sizeof(MAGIC)) == 0 && header_->version == VERSION;
+  for (size_t section = 0; valid && section < SECTION_COUNT; ++section) {
+    const auto& ref = header_->sections[section];
+    valid = ref.offset % SECTION_ALIGNMENT == 0 && ref.offset <= size_ && ref.size <= size_ - ref.offset;
+  }
+  if (!valid) {
+    munmap(const_cast<char*>(data_), size_);
+    throw runtime_error("invalid flat base file " + file_name);
+  }
+}
+
+FlatBase::~FlatBase() {
+  munmap(const_cast<char*>(data_), size_);
+}
+
+uint32_t FlatBase::BusWaitTime() const {
+  return SectionData<Settings>(SETTINGS)->bus_wait_time;
+}
+
+double FlatBase::BusVelocity() const {
+  return SectionData<Settings>(SETTINGS)->bus_velocity;
+}
+
+template <typename Item>
+optional<size_t> FlatBase::FindByName(Section index, Section items, string_view name) const {
+  const uint32_t* slots = SectionData<uint32_t>(index);
+  const size_t mask = SectionLength<uint32_t>(index) - 1;
+  for (size_t slot = HashName(name) & mask; slots[slot]; slot = (slot + 1) & mask) {
+    const size_t id = slots[slot] - 1;
+    if (GetString(SectionData<Item>(items)[id].name) == name) {
+      return id;
+    }
+  }
+  return nullopt;
+}
+
+optional<size_t> FlatBase::FindStop(string_view name) const {
+  return FindByName<Stop>(STOP_INDEX, STOPS, name);
+}
+
+optional<size_t> FlatBase::FindBus(string_view name) const {
+  return FindByName<Bus>(BUS_INDEX, BUSES, name);
+}
+
+size_t FlatBase::StopCount() const {
+  return SectionLength<Stop>(STOPS);
+}
+
+const FlatBase::Stop& FlatBase::GetStop(size_t stop_id) const {
+  return SectionData<Stop>(STOPS)[stop_id];
+}
+
+const FlatBase::Bus& FlatBase::GetBus(size_t bus_id) const {
+  return SectionData<Bus>(BUSES)[bus_id];
+}
+
+const FlatBase::Activity& FlatBase::GetActivity(size_t edge_id) const {
+  return SectionData<Activity>(ACTIVITIES)[edge_id];
+}
+
+string_view FlatBase::GetString(StringRef ref) const {
+  return {SectionData<char>(STRINGS) + ref.offset, ref.length};
+}
+
+uint32_t FlatBase::EdgeFrom(size_t edge_id) const {
+  return SectionData<uint32_t>(EDGE_FROM)[edge_id];
+}
+
+uint32_t FlatBase::RoutePrevEdge(size_t from_stop_id, size_t vertex) const {
+  return SectionData<uint32_t>(ROUTE_PREV_EDGES)[from_stop_id * header_->vertex_count + vertex];
+}
+
+double FlatBase::RouteWeight(size_t from_stop_id, size_t to_stop_id) const {
+  return SectionData<double>(ROUTE_WEIGHTS)[from_stop_id * StopCount() + to_stop_id];
+}
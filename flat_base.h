@@ -0,0 +1,138 @@
+#pragma once
+
+#include "route_tree_spill.h"
+#include "transport_catalog.pb.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <string_view>
+
+// Base file that is used in place instead of being parsed: a header with the
+// offsets of fixed-layout sections, followed by the sections themselves. All
+// names live in one string table and are referenced by offset and length;
+// stops and buses are found by name through open addressing hash tables
+// stored in the file. The reader maps the file read-only, so opening a base
+// costs the same whatever its size and the page cache is shared between
+// processes. Only bases with all-pairs routes can be written in this format.
+class FlatBase {
+public:
+  struct StringRef {
+    uint32_t offset;
+    uint32_t length;
+  };
+
+  // Responses are rendered by make_base, missing the request id that goes
+  // at request_id_offset
+  struct Stop {
+    StringRef name;
+    StringRef response;
+    uint32_t request_id_offset;
+    uint32_t padding;
+  };
+
+  struct Bus {
+    StringRef name;
+    StringRef response;
+    uint32_t request_id_offset;
+    uint32_t padding;
+  };
+
+  enum class ActivityKind : uint32_t {
+    WAIT,
+    BUS,
+  };
+
+  // Description of a graph edge: a wait at the named stop or a ride of the
+  // named bus
+  struct Activity {
+    double time;
+    StringRef name;
+    ActivityKind kind;
+    uint32_t span_count;
+    uint32_t start_stop_idx;
+    uint32_t padding;
+  };
+
+  // Route trees are read twice and never held in memory at once
+  static void Write(const TransportGuide::TransportCatalog& base, size_t vertex_count,
+                    const RouteTreeSource& route_trees, std::ostream& out);
+  static bool IsFlatBase(const std::string& file_name);
+
+  explicit FlatBase(const std::string& file_name);
+  FlatBase(const FlatBase&) = delete;
+  FlatBase& operator=(const FlatBase&) = delete;
+  ~FlatBase();
+
+  uint32_t BusWaitTime() const;
+  double BusVelocity() const;
+
+  std::optional<size_t> FindStop(std::string_view name) const;
+  std::optional<size_t> FindBus(std::string_view name) const;
+  size_t StopCount() const;
+
+  const Stop& GetStop(size_t stop_id) const;
+  const Bus& GetBus(size_t bus_id) const;
+  const Activity& GetActivity(size_t edge_id) const;
+  std::string_view GetString(StringRef ref) const;
+
+  uint32_t EdgeFrom(size_t edge_id) const;
+  // The last edge of the route from the stop to the vertex plus one, 0 if
+  // there is no such edge
+  uint32_t RoutePrevEdge(size_t from_stop_id, size_t vertex) const;
+  double RouteWeight(size_t from_stop_id, size_t to_stop_id) const;
+
+private:
+  enum Section {
+    SETTINGS,
+    STRINGS,
+    STOPS,
+    BUSES,
+    STOP_INDEX,
+    BUS_INDEX,
+    ACTIVITIES,
+    EDGE_FROM,
+    ROUTE_PREV_EDGES,
+    ROUTE_WEIGHTS,
+    SECTION_COUNT,
+  };
+
+  struct SectionRef {
+    uint64_t offset;
+    uint64_t size;
+  };
+
+  struct Header {
+    char magic[8];
+    uint32_t version;
+    uint32_t vertex_count;
+    SectionRef sections[SECTION_COUNT];
+  };
+
+  struct Settings {
+    uint32_t bus_wait_time;
+    uint32_t padding;
+    double bus_velocity;
+  };
+
+  static constexpr char MAGIC[8] = {'T', 'G', 'F', 'L', 'A', 'T', '\0', '\0'};
+  static constexpr uint32_t VERSION = 3;
+
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+  const Header* header_ = nullptr;
+
+  template <typename T>
+  const T* SectionData(Section section) const {
+    return reinterpret_cast<const T*>(data_ + header_->sections[section].offset);
+  }
+  template <typename T>
+  size_t SectionLength(Section section) const {
+    return header_->sections[section].size / sizeof(T);
+  }
+
+  template <typename Item>
+  std::optional<size_t> FindByName(Section index, Section items, std::string_view name) const;
+};
@@ -1,7 +1,13 @@
 #pragma once
 
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
 #include <cstdlib>
 #include <deque>
+#include <iterator>
+#include <limits>
+#include <numeric>
 #include <vector>
 
 template <typename It>
@@ -23,6 +29,9 @@ namespace Graph {
   using VertexId = size_t;
   using EdgeId = size_t;
 
+  // Vertex, edge and arc ids as stored by a frozen graph
+  using CompactId = uint32_t;
+
   template <typename Weight>
   struct Edge {
     VertexId from;
@@ -30,57 +39,133 @@ namespace Graph {
     Weight weight;
   };
 
+  // Edges are collected by AddEdge and then packed by Freeze into compressed
+  // sparse row arrays: the outgoing edges (arcs) of a vertex occupy the
+  // contiguous range [offsets_[v], offsets_[v + 1]) of the arc arrays.
+  // Edge ids keep their insertion order, and each arc also records its
+  // source so that GetEdge stays O(1). Only a frozen graph can be traversed.
   template <typename Weight>
   class DirectedWeightedGraph {
   private:
-    using IncidenceList = std::vector<EdgeId>;
-    using IncidentEdgesRange = Range<typename IncidenceList::const_iterator>;
+    using IncidentEdgesRange = Range<const CompactId*>;
 
   public:
+    struct ArcRange {
+      CompactId begin;
+      CompactId end;
+    };
+
     DirectedWeightedGraph(size_t vertex_count);
     EdgeId AddEdge(const Edge<Weight>& edge);
+    void Freeze();
+    bool IsFrozen() const;
 
     size_t GetVertexCount() const;
     size_t GetEdgeCount() const;
-    const Edge<Weight>& GetEdge(EdgeId edge_id) const;
+    Edge<Weight> GetEdge(EdgeId edge_id) const;
     IncidentEdgesRange GetIncidentEdges(VertexId vertex) const;
 
+    ArcRange GetIncidentArcs(VertexId vertex) const;
+    VertexId GetArcTarget(CompactId arc) const { return arc_targets_[arc]; }
+    Weight GetArcWeight(CompactId arc) const { return arc_weights_[arc]; }
+    EdgeId GetArcEdge(CompactId arc) const { return arc_edges_[arc]; }
+
   private:
+    size_t vertex_count_;
     std::vector<Edge<Weight>> edges_;
-    std::vector<IncidenceList> incidence_lists_;
+
+    std::vector<CompactId> offsets_;
+    std::vector<CompactId> arc_sources_;
+    std::vector<CompactId> arc_targets_;
+    std::vector<Weight> arc_weights_;
+    std::vector<CompactId> arc_edges_;
+    std::vector<CompactId> edge_arcs_;
   };
 
 
   template <typename Weight>
-  DirectedWeightedGraph<Weight>::DirectedWeightedGraph(size_t vertex_count) : incidence_lists_(vertex_count) {}
+  DirectedWeightedGraph<Weight>::DirectedWeightedGraph(size_t vertex_count) : vertex_count_(vertex_count) {}
 
   template <typename Weight>
   EdgeId DirectedWeightedGraph<Weight>::AddEdge(const Edge<Weight>& edge) {
+    assert(!IsFrozen());
     edges_.push_back(edge);
-    const EdgeId id = edges_.size() - 1;
-    incidence_lists_[edge.from].push_back(id);
-    return id;
+    return edges_.size() - 1;
+  }
+
+  template <typename Weight>
+  void DirectedWeightedGraph<Weight>::Freeze() {
+    if (IsFrozen()) {
+      return;
+    }
+    assert(vertex_count_ < std::numeric_limits<CompactId>::max());
+    assert(edges_.size() < std::numeric_limits<CompactId>::max());
+
+    offsets_.assign(vertex_count_ + 1, 0);
+    for (const auto& edge : edges_) {
+      ++offsets_[edge.from + 1];
+    }
+    std::partial_sum(std::begin(offsets_), std::end(offsets_), std::begin(offsets_));
+
+    std::vector<CompactId> next_arc{std::begin(offsets_), std::prev(std::end(offsets_))};
+    arc_sources_.resize(edges_.size());
+    arc_targets_.resize(edges_.size());
+    arc_weights_.resize(edges_.size());
+    arc_edges_.resize(edges_.size());
+    edge_arcs_.resize(edges_.size());
+    for (size_t edge_id = 0; edge_id < edges_.size(); ++edge_id) {
+      const auto& edge = edges_[edge_id];
+      const CompactId arc = next_arc[edge.from]++;
+      arc_sources_[arc] = edge.from;
+      arc_targets_[arc] = edge.to;
+      arc_weights_[arc] = edge.weight;
+      arc_edges_[arc] = edge_id;
+      edge_arcs_[edge_id] = arc;
+    }
+
+    edges_.clear();
+    edges_.shrink_to_fit();
+  }
+
+  template <typename Weight>
+  bool DirectedWeightedGraph<Weight>::IsFrozen() const {
+    return !offsets_.empty();
   }
 
   template <typename Weight>
   size_t DirectedWeightedGraph<Weight>::GetVertexCount() const {
-    return incidence_lists_.size();
+    return vertex_count_;
   }
 
   template <typename Weight>
   size_t DirectedWeightedGraph<Weight>::GetEdgeCount() const {
-    return edges_.size();
+    return IsFrozen() ? edge_arcs_.size() : edges_.size();
   }
 
   template <typename Weight>
-  const Edge<Weight>& DirectedWeightedGraph<Weight>::GetEdge(EdgeId edge_id) const {
-    return edges_[edge_id];
+  Edge<Weight> DirectedWeightedGraph<Weight>::GetEdge(EdgeId edge_id) const {
+    if (!IsFrozen()) {
+      return edges_[edge_id];
+    }
+    const CompactId arc = edge_arcs_[edge_id];
+    return {
+      arc_sources_[arc],
+      arc_targets_[arc],
+      arc_weights_[arc],
+    };
   }
 
   template <typename Weight>
   typename DirectedWeightedGraph<Weight>::IncidentEdgesRange
   DirectedWeightedGraph<Weight>::GetIncidentEdges(VertexId vertex) const {
-    const auto& edges = incidence_lists_[vertex];
-    return {std::begin(edges), std::end(edges)};
+    assert(IsFrozen());
+    return {arc_edges_.data() + offsets_[vertex], arc_edges_.data() + offsets_[vertex + 1]};
+  }
+
+  template <typename Weight>
+  typename DirectedWeightedGraph<Weight>::ArcRange
+  DirectedWeightedGraph<Weight>::GetIncidentArcs(VertexId vertex) const {
+    assert(IsFrozen());
+    return {offsets_[vertex], offsets_[vertex + 1]};
   }
 }
@@ -1,178 +1,725 @@
 #include "json.h"
 
-#include <iomanip>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <stdexcept>
+#include <utility>
 #include <variant>
 
 using namespace std;
 
 namespace Json {
 
+  Buffer Buffer::Read(istream& input) {
+    constexpr size_t CHUNK_SIZE = 1 << 16;
+
+    Buffer buffer;
+    size_t size = 0;
+    for (;;) {
+      buffer.owned_.resize(size + CHUNK_SIZE);
+      const size_t read = input.rdbuf()->sgetn(buffer.owned_.data() + size, CHUNK_SIZE);
+      size += read;
+      if (read < CHUNK_SIZE) {
+        break;
+      }
+    }
+    buffer.owned_.resize(size);
+    buffer.owned_.resize(size + PADDING, '\0');
+    buffer.data_ = buffer.owned_.data();
+    buffer.size_ = size;
+    return buffer;
+  }
+
+  Buffer Buffer::ReadFile(const string& file_name) {
+    const int fd = open(file_name.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw runtime_error("cannot open input file " + file_name);
+    }
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0) {
+      close(fd);
+      throw runtime_error("cannot open input file " + file_name);
+    }
+
+    // The rest of the last page reads as zeros; a private writable mapping
+    // lets strings be unescaped without touching the file
+    const size_t size = file_stat.st_size;
+    const size_t page_size = sysconf(_SC_PAGESIZE);
+    const size_t tail = size % page_size;
+    if (size > 0 && tail != 0 && page_size - tail >= PADDING) {
+      void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+      if (data != MAP_FAILED) {
+        close(fd);
+        Buffer buffer;
+        buffer.data_ = static_cast<char*>(data);
+        buffer.size_ = size;
+        buffer.mapped_size_ = size;
+        return buffer;
+      }
+    }
+    close(fd);
+
+    ifstream input(file_name, ios::binary);
+    return Read(input);
+  }
+
+  Buffer::Buffer(Buffer&& other) noexcept
+    : owned_(move(other.owned_))
+    , data_(exchange(other.data_, nullptr))
+    , size_(exchange(other.size_, 0))
+    , mapped_size_(exchange(other.mapped_size_, 0))
+  {
+  }
+
+  Buffer& Buffer::operator=(Buffer&& other) noexcept {
+    swap(owned_, other.owned_);
+    swap(data_, other.data_);
+    swap(size_, other.size_);
+    swap(mapped_size_, other.mapped_size_);
+    return *this;
+  }
+
+  Buffer::~Buffer() {
+    if (mapped_size_) {
+      munmap(data_, mapped_size_);
+    }
+  }
+
   Document::Document(Node root) : root(move(root)) {
   }
 
+  Document::Document(Buffer buffer, Node root) : buffer(move(buffer)), root(move(root)) {
+  }
+
   const Node& Document::GetRoot() const {
     return root;
   }
 
-  Node LoadNode(istream& input);
+  // The tree builder steps through the structural index of the buffer and
+  // reads bytes only within strings and scalars. Past the last token the
+  // index gives the input size, where the zero padding fails every match.
+  struct Tokens {
+    char* data;
+    StructuralIndex& index;
+
+    char Peek() {
+      return data[index.Peek()];
+    }
+    char* Take() {
+      return data + index.Next();
+    }
+  };
+
+  [[noreturn]] void ThrowInvalid(const char* input) {
+    throw invalid_argument(string("invalid JSON near \"") + string(input, strnlen(input, 16)) + "\"");
+  }
+
+  bool IsDigit(char c) {
+    return c >= '0' && c <= '9';
+  }
+
+  bool IsSpace(char c) {
+    return c == ' ' || c == '\n' || c == '\r' || c == '\t';
+  }
 
-  Node LoadArray(istream& input) {
+  void Expect(Tokens& tokens, char c) {
+    const char* token = tokens.Take();
+    if (*token != c) {
+      ThrowInvalid(token);
+    }
+  }
+
+  Node LoadNode(Tokens& tokens);
+
+  Node LoadArray(Tokens& tokens) {
     vector<Node> result;
 
-    for (char c; input >> c && c != ']'; ) {
-      if (c != ',') {
-        input.putback(c);
+    if (tokens.Peek() == ']') {
+      tokens.Take();
+      return Node(move(result));
+    }
+    for (;;) {
+      result.push_back(LoadNode(tokens));
+      const char* token = tokens.Take();
+      if (*token == ']') {
+        break;
+      }
+      if (*token != ',') {
+        ThrowInvalid(token);
       }
-      result.push_back(LoadNode(input));
     }
 
     return Node(move(result));
   }
 
-  Node LoadInt(istream& input) {
-    int result = 0;
-    while (isdigit(input.peek())) {
-      result *= 10;
-      result += input.get() - '0';
+  int HexDigit(char c) {
+    if (c >= '0' && c <= '9') {
+      return c - '0';
+    }
+    c |= 0x20;
+    if (c >= 'a' && c <= 'f') {
+      return c - 'a' + 10;
     }
-    return Node(result);
+    return -1;
   }
 
-  Node LoadUnsignedDecimal(istream& input) {
-    int result = 0;
-
-    int sign = 1;
-    if (input.peek() == '-') {
-      input.ignore();
-      sign = -1;
+  uint32_t LoadHex4(char*& input) {
+    uint32_t result = 0;
+    for (int i = 0; i < 4; ++i) {
+      const int digit = HexDigit(*input);
+      if (digit < 0) {
+        ThrowInvalid(input);
+      }
+      result = result << 4 | digit;
+      ++input;
     }
+    return result;
+  }
 
-    while (isdigit(input.peek())) {
-      result *= 10;
-      result += input.get() - '0';
+  char* AppendUtf8(char* output, uint32_t code_point) {
+    if (code_point < 0x80) {
+      *output++ = code_point;
+    } else if (code_point < 0x800) {
+      *output++ = 0xc0 | code_point >> 6;
+      *output++ = 0x80 | (code_point & 0x3f);
+    } else if (code_point < 0x10000) {
+      *output++ = 0xe0 | code_point >> 12;
+      *output++ = 0x80 | (code_point >> 6 & 0x3f);
+      *output++ = 0x80 | (code_point & 0x3f);
+    } else {
+      *output++ = 0xf0 | code_point >> 18;
+      *output++ = 0x80 | (code_point >> 12 & 0x3f);
+      *output++ = 0x80 | (code_point >> 6 & 0x3f);
+      *output++ = 0x80 | (code_point & 0x3f);
     }
+    return output;
+  }
 
-    if (input.peek() != '.') {
-      return Node(sign * result);
+  // Unescapes the string over itself, which only ever shortens it, and
+  // returns its new end
+  char* Unescape(char* input, const char* end) {
+    char* output = input;
+    while (input != end) {
+      if (*input != '\\') {
+        *output++ = *input++;
+        continue;
+      }
+      ++input;
+      switch (*input++) {
+        case '"': *output++ = '"'; break;
+        case '\\': *output++ = '\\'; break;
+        case '/': *output++ = '/'; break;
+        case 'b': *output++ = '\b'; break;
+        case 'f': *output++ = '\f'; break;
+        case 'n': *output++ = '\n'; break;
+        case 'r': *output++ = '\r'; break;
+        case 't': *output++ = '\t'; break;
+        case 'u': {
+          uint32_t code_point = LoadHex4(input);
+          if (code_point >= 0xd800 && code_point < 0xdc00 && end - input >= 6 && input[0] == '\\' && input[1] == 'u') {
+            char* low_begin = input + 2;
+            const uint32_t low = LoadHex4(low_begin);
+            if (low >= 0xdc00 && low < 0xe000) {
+              code_point = 0x10000 + ((code_point - 0xd800) << 10) + (low - 0xdc00);
+              input = low_begin;
+            }
+          }
+          output = AppendUtf8(output, code_point);
+          break;
+        }
+        default:
+          ThrowInvalid(input - 2);
+      }
     }
+    return output;
+  }
 
-    input.ignore();
-    double double_res = result;
-    double factor = 0.1;
-    while (isdigit(input.peek())) {
-      int digit = input.get() - '0';
-      double_res += digit * factor;
-      factor *= 0.1;
+  // The closing quote of a string is the token after its opening one
+  string_view LoadStringView(Tokens& tokens) {
+    char* const begin = tokens.Take() + 1;
+    const char* const end = tokens.Take();
+    if (!memchr(begin, '\\', end - begin)) {
+      return string_view(begin, end - begin);
     }
-    return Node(sign * double_res);
+    return string_view(begin, Unescape(begin, end) - begin);
   }
 
-  Node LoadString(istream& input) {
-    string line;
-    getline(input, line, '"');
-    return Node(move(line));
+  Node LoadString(Tokens& tokens) {
+    return Node(LoadStringView(tokens));
   }
 
-  Node LoadBool(istream& input) {
-    string value(5, '\0');
+  // Up to eight ASCII digits are read as one little-endian word: a mask
+  // finds where they end, and after padding them with leading '0's they are
+  // converted with three multiplications instead of a step per digit
+  uint64_t ParseEightDigits(uint64_t word) {
+    word -= 0x3030303030303030;
+    word = word * 10 + (word >> 8);
+    return (((word & 0x000000ff000000ff) * 0x000f424000000064)
+            + (((word >> 16) & 0x000000ff000000ff) * 0x0000271000000001)) >> 32;
+  }
 
-    for (int i = 0; i < 4; ++i) {
-      input >> value[i];
+  // Appends the digits at input to value and returns their count; only the
+  // first 19 fit without overflow
+  inline size_t LoadDigits(char*& input, uint64_t& value) {
+    size_t digit_count = 0;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    static constexpr uint64_t POWERS_OF_TEN[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+    for (;;) {
+      uint64_t word;
+      memcpy(&word, input, sizeof(word));
+      // Bytes below '0' or above '9' get their high bit set; lanes are
+      // exact up to the first such byte
+      const uint64_t non_digits = ((word - 0x3030303030303030) | (word + 0x4646464646464646)) & 0x8080808080808080;
+      const size_t count = non_digits ? __builtin_ctzll(non_digits) / 8 : 8;
+      if (count == 0) {
+        return digit_count;
+      }
+      if (count < 8) {
+        word = word << (8 * (8 - count)) | 0x3030303030303030 >> (8 * count);
+      }
+      value = value * POWERS_OF_TEN[count] + ParseEightDigits(word);
+      input += count;
+      digit_count += count;
+      if (count < 8) {
+        return digit_count;
+      }
+    }
+#else
+    for (; IsDigit(*input); ++input, ++digit_count) {
+      value = value * 10 + (*input - '0');
+    }
+    return digit_count;
+#endif
+  }
+
+  // Integers that fit an int become ints, all other numbers doubles. A
+  // mantissa of up to 53 bits scaled by an exactly representable power of
+  // ten is rounded correctly by one division or multiplication; anything
+  // else goes to from_chars.
+  Node LoadNumber(char*& input) {
+    static constexpr double POWERS_OF_TEN[] = {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+    constexpr int MAX_EXACT_POWER = 22;
+    constexpr uint64_t MAX_EXACT_MANTISSA = uint64_t{1} << 53;
+    constexpr size_t MAX_MANTISSA_DIGITS = 19;
+
+    char* const begin = input;
+    const bool negative = *input == '-';
+    if (negative) {
+      ++input;
+    }
+    if (!IsDigit(*input)) {
+      ThrowInvalid(begin);
     }
 
-    if (value.substr(0, 4) == "true") {
+    uint64_t mantissa = 0;
+    size_t digit_count = LoadDigits(input, mantissa);
+    bool is_integer = true;
+    int64_t exponent = 0;
+
+    if (*input == '.') {
+      ++input;
+      is_integer = false;
+      const size_t fraction_digit_count = LoadDigits(input, mantissa);
+      if (fraction_digit_count == 0) {
+        ThrowInvalid(begin);
+      }
+      digit_count += fraction_digit_count;
+      exponent = -static_cast<int64_t>(fraction_digit_count);
+    }
+
+    if (*input == 'e' || *input == 'E') {
+      ++input;
+      is_integer = false;
+      const bool negative_exponent = *input == '-';
+      if (*input == '-' || *input == '+') {
+        ++input;
+      }
+      if (!IsDigit(*input)) {
+        ThrowInvalid(begin);
+      }
+      int64_t exponent_value = 0;
+      for (; IsDigit(*input); ++input) {
+        exponent_value = min<int64_t>(exponent_value * 10 + (*input - '0'), numeric_limits<int32_t>::max());
+      }
+      exponent += negative_exponent ? -exponent_value : exponent_value;
+    }
+
+    if (digit_count <= MAX_MANTISSA_DIGITS) {
+      if (is_integer && mantissa <= static_cast<uint64_t>(numeric_limits<int>::max()) + negative) {
+        return Node(static_cast<int>(negative ? -static_cast<int64_t>(mantissa) : static_cast<int64_t>(mantissa)));
+      }
+      if (mantissa <= MAX_EXACT_MANTISSA && exponent >= -MAX_EXACT_POWER && exponent <= MAX_EXACT_POWER) {
+        double value = static_cast<double>(mantissa);
+        value = exponent < 0 ? value / POWERS_OF_TEN[-exponent] : value * POWERS_OF_TEN[exponent];
+        return Node(negative ? -value : value);
+      }
+    }
+
+    // from_chars leaves the value alone when it is out of range; strtod
+    // gives underflows as zero or a denormal
+    double value = 0;
+    const auto [end, error] = from_chars(begin, input, value);
+    if (error == errc::result_out_of_range) {
+      value = strtod(begin, nullptr);
+    } else if (error != errc{} || end != input) {
+      ThrowInvalid(begin);
+    }
+    if (isinf(value)) {
+      ThrowInvalid(begin);
+    }
+    return Node(value);
+  }
+
+  Node LoadBool(char*& input) {
+    if (memcmp(input, "true", 4) == 0) {
+      input += 4;
       return Node(true);
     }
+    if (memcmp(input, "false", 5) == 0) {
+      input += 5;
+      return Node(false);
+    }
+    ThrowInvalid(input);
+  }
 
-    input >> value[4];
-    return Node(false);
+  Node LoadScalarValue(char*& input) {
+    return *input == 't' || *input == 'f' ? LoadBool(input) : LoadNumber(input);
   }
 
-  Node LoadDict(istream& input) {
-    map<string, Node> result;
+  // A scalar must take up its whole run of bytes up to the next token or
+  // whitespace
+  Node LoadScalar(Tokens& tokens) {
+    char* input = tokens.Take();
+    Node result = LoadScalarValue(input);
+    if (input != tokens.data + tokens.index.Peek() && !IsSpace(*input)) {
+      ThrowInvalid(input);
+    }
+    return result;
+  }
 
-    for (char c; input >> c && c != '}'; ) {
-      if (c == ',') {
-        input >> c;
+  Node LoadDict(Tokens& tokens) {
+    map<string_view, Node> result;
+
+    if (tokens.Peek() == '}') {
+      tokens.Take();
+      return Node(move(result));
+    }
+    for (;;) {
+      if (tokens.Peek() != '"') {
+        ThrowInvalid(tokens.Take());
       }
+      const string_view key = LoadStringView(tokens);
+      Expect(tokens, ':');
+      result.emplace(key, LoadNode(tokens));
 
-      string key = LoadString(input).AsString();
-      input >> c;
-      result.emplace(move(key), LoadNode(input));
+      const char* token = tokens.Take();
+      if (*token == '}') {
+        break;
+      }
+      if (*token != ',') {
+        ThrowInvalid(token);
+      }
     }
 
     return Node(move(result));
   }
 
-  Node LoadNode(istream& input) {
-    char c;
-    input >> c;
+  Node LoadNode(Tokens& tokens) {
+    const char c = tokens.Peek();
 
     if (c == '[') {
-      return LoadArray(input);
+      tokens.Take();
+      return LoadArray(tokens);
     } else if (c == '{') {
-      return LoadDict(input);
+      tokens.Take();
+      return LoadDict(tokens);
     } else if (c == '"') {
-      return LoadString(input);
-    } else if (c == 't' || c == 'f') {
-      input.putback(c);
-      return LoadBool(input);
+      return LoadString(tokens);
     } else {
-      input.putback(c);
-      return LoadUnsignedDecimal(input);
+      return LoadScalar(tokens);
     }
   }
 
+  Reader::Reader(Buffer buffer)
+    : buffer_(move(buffer))
+    , index_(buffer_.Data(), buffer_.Size())
+  {
+  }
+
+  void Reader::EnterObject() {
+    Tokens tokens{buffer_.Data(), index_};
+    Expect(tokens, '{');
+    first_ = true;
+  }
+
+  optional<string_view> Reader::NextKey() {
+    Tokens tokens{buffer_.Data(), index_};
+    if (tokens.Peek() == '}') {
+      tokens.Take();
+      first_ = false;
+      return nullopt;
+    }
+    if (!first_) {
+      Expect(tokens, ',');
+    }
+    first_ = false;
+
+    if (tokens.Peek() != '"') {
+      ThrowInvalid(tokens.Take());
+    }
+    const string_view key = LoadStringView(tokens);
+    Expect(tokens, ':');
+    return key;
+  }
+
+  void Reader::EnterArray() {
+    Tokens tokens{buffer_.Data(), index_};
+    Expect(tokens, '[');
+    first_ = true;
+  }
+
+  bool Reader::NextElement() {
+    Tokens tokens{buffer_.Data(), index_};
+    if (tokens.Peek() == ']') {
+      tokens.Take();
+      first_ = false;
+      return false;
+    }
+    if (!first_) {
+      Expect(tokens, ',');
+    }
+    first_ = false;
+    return true;
+  }
+
+  Node Reader::ReadNode() {
+    Tokens tokens{buffer_.Data(), index_};
+    return LoadNode(tokens);
+  }
+
+  string_view Reader::ReadString() {
+    return ReadNode().AsString();
+  }
+
+  int Reader::ReadInt() {
+    return ReadNode().AsInt();
+  }
+
+  double Reader::ReadDouble() {
+    return ReadNode().AsDouble();
+  }
+
+  bool Reader::ReadBool() {
+    return ReadNode().AsBool();
+  }
+
+  void Reader::Skip() {
+    ReadNode();
+  }
+
+  Document Load(Buffer buffer) {
+    StructuralIndex index(buffer.Data(), buffer.Size());
+    Tokens tokens{buffer.Data(), index};
+    // Nothing after the root is looked at, even right after a scalar one
+    char* input = tokens.data + tokens.index.Peek();
+    Node root = *input == '[' || *input == '{' || *input == '"' ? LoadNode(tokens) : LoadScalarValue(input);
+    return Document{move(buffer), move(root)};
+  }
+
   Document Load(istream& input) {
-    return Document{LoadNode(input)};
+    return Load(Buffer::Read(input));
+  }
+
+  Writer::Writer(ostream& output)
+    : output_(output)
+    , buffer_(BUFFER_SIZE)
+  {
+  }
+
+  Writer::~Writer() {
+    Flush();
+  }
+
+  void Writer::BeginValue() {
+    if (after_key_) {
+      after_key_ = false;
+    } else if (!first_) {
+      Append(", ");
+    }
+    first_ = false;
+  }
+
+  // format prints into a range and fails if it is too short; an empty
+  // buffer is long enough for any number
+  template <typename Format>
+  void Writer::AppendFormatted(Format format) {
+    char* const end = buffer_.data() + buffer_.size();
+    to_chars_result result = format(buffer_.data() + size_, end);
+    if (result.ec != errc{}) {
+      Flush();
+      result = format(buffer_.data(), end);
+    }
+    size_ = result.ptr - buffer_.data();
+  }
+
+  void Writer::BeginObject() {
+    BeginValue();
+    Append("{");
+    first_ = true;
   }
 
-  void PrintNode(const Node& node, std::ostream& output) {
+  void Writer::EndObject() {
+    Append("}");
+    first_ = false;
+  }
+
+  void Writer::Key(string_view key) {
+    if (!first_) {
+      Append(", ");
+    }
+    first_ = false;
+    AppendQuoted(key);
+    Append(": ");
+    after_key_ = true;
+  }
+
+  void Writer::BeginArray() {
+    BeginValue();
+    Append("[");
+    first_ = true;
+  }
+
+  void Writer::EndArray() {
+    Append("]");
+    first_ = false;
+  }
+
+  void Writer::WriteNode(const Node& node) {
     if (holds_alternative<vector<Node>>(node)) {
-      output << "[";
-      bool first_elem = true;
+      BeginArray();
       for (const auto& elem : node.AsArray()) {
-        if (first_elem) {
-          first_elem = false;
-        }
-        else {
-          output << ", ";
-        }
-        PrintNode(elem, output);
+        WriteNode(elem);
       }
-      output << "]";
+      EndArray();
     }
-    else if (holds_alternative<std::map<std::string, Node>>(node)) {
-      output << "{";
-      bool first_elem = true;
+    else if (holds_alternative<Dict>(node)) {
+      BeginObject();
       for (const auto& [key, value] : node.AsMap()) {
-        if (first_elem) {
-          first_elem = false;
-        }
-        else {
-          output << ", ";
-        }
-        output << "\"" << key << "\"" << ": ";
-        PrintNode(value, output);
+        Key(key);
+        WriteNode(value);
       }
-      output << "}";
+      EndObject();
     }
     else if (holds_alternative<int>(node)) {
-      output << node.AsInt();
+      WriteInt(node.AsInt());
     }
     else if (holds_alternative<double>(node)) {
-      output << fixed << setprecision(6) << node.AsDouble();
+      WriteDouble(node.AsDouble());
     }
     else if (holds_alternative<bool>(node)) {
-      output << boolalpha << node.AsBool();
+      WriteBool(node.AsBool());
     }
-    else if (holds_alternative<string>(node)) {
-      output << "\"" << node.AsString() << "\"";
+    else if (node.IsString()) {
+      WriteString(node.AsString());
     }
   }
 
+  void Writer::WriteString(string_view value) {
+    BeginValue();
+    AppendQuoted(value);
+  }
+
+  void Writer::WriteInt(int value) {
+    BeginValue();
+    Append(value);
+  }
+
+  // Six decimals, as the responses have always been printed
+  void Writer::WriteDouble(double value) {
+    BeginValue();
+    AppendFormatted([value](char* first, char* last) { return to_chars(first, last, value, chars_format::fixed, 6); });
+  }
+
+  void Writer::WriteBool(bool value) {
+    BeginValue();
+    Append(value ? "true" : "false");
+  }
+
+  void Writer::WriteRaw(string_view text) {
+    BeginValue();
+    Append(text);
+  }
+
+  void Writer::Append(string_view text) {
+    if (text.size() > buffer_.size() - size_) {
+      Flush();
+      if (text.size() > buffer_.size()) {
+        output_.write(text.data(), text.size());
+        return;
+      }
+    }
+    memcpy(buffer_.data() + size_, text.data(), text.size());
+    size_ += text.size();
+  }
+
+  // Escapes what JSON does not allow in a string as is; runs that need no
+  // escaping are copied whole
+  void Writer::AppendQuoted(string_view text) {
+    static constexpr char HEX_DIGITS[] = "0123456789abcdef";
+
+    Append("\"");
+    size_t run_begin = 0;
+    for (size_t i = 0; i < text.size(); ++i) {
+      const unsigned char c = text[i];
+      if (c != '"' && c != '\\' && c >= 0x20) {
+        continue;
+      }
+      Append(text.substr(run_begin, i - run_begin));
+      run_begin = i + 1;
+      switch (c) {
+        case '"': Append("\\\""); break;
+        case '\\': Append("\\\\"); break;
+        case '\b': Append("\\b"); break;
+        case '\f': Append("\\f"); break;
+        case '\n': Append("\\n"); break;
+        case '\r': Append("\\r"); break;
+        case '\t': Append("\\t"); break;
+        default: {
+          const char escape[] = {'\\', 'u', '0', '0', HEX_DIGITS[c >> 4], HEX_DIGITS[c & 0xf]};
+          Append(string_view(escape, sizeof(escape)));
+        }
+      }
+    }
+    Append(text.substr(run_begin));
+    Append("\"");
+  }
+
+  void Writer::Append(int value) {
+    AppendFormatted([value](char* first, char* last) { return to_chars(first, last, value); });
+  }
+
+  void Writer::Flush() {
+    output_.write(buffer_.data(), size_);
+    size_ = 0;
+  }
+
   void Print(const Document& doc, std::ostream& output) {
-    PrintNode(doc.GetRoot(), output);
+    Writer writer(output);
+    writer.WriteNode(doc.GetRoot());
   }
 
 }
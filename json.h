@@ -1,19 +1,28 @@
 #pragma once
 
+#include "json_index.h"
+
+#include <cstddef>
 #include <istream>
 #include <map>
+#include <optional>
+#include <ostream>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
 namespace Json {
 
+  // Parsed strings and keys are views into the input buffer of their
+  // document, printed ones may own their text
   class Node : public std::variant<std::vector<Node>,
-                                   std::map<std::string, Node>,
+                                   std::map<std::string_view, Node>,
                                    int,
                                    double,
                                    bool,
-                                   std::string> {
+                                   std::string,
+                                   std::string_view> {
   public:
     using variant::variant;
 
@@ -21,7 +30,7 @@ namespace Json {
       return std::get<std::vector<Node>>(*this);
     }
     const auto& AsMap() const {
-      return std::get<std::map<std::string, Node>>(*this);
+      return std::get<std::map<std::string_view, Node>>(*this);
     }
     int AsInt() const {
       return std::get<int>(*this);
@@ -32,28 +41,133 @@ namespace Json {
     bool AsBool() const {
       return std::get<bool>(*this);
     }
-    const auto& AsString() const {
-      return std::get<std::string>(*this);
+    std::string_view AsString() const {
+      return std::holds_alternative<std::string_view>(*this) ? std::get<std::string_view>(*this) : std::get<std::string>(*this);
     }
 
     const bool IsArray() const {
       return std::holds_alternative<std::vector<Node>>(*this);
     }
     const bool IsString() const {
-      return std::holds_alternative<std::string>(*this);
+      return std::holds_alternative<std::string>(*this) || std::holds_alternative<std::string_view>(*this);
     }
   };
 
+  using Dict = std::map<std::string_view, Node>;
+
+  // The whole input in one piece, followed by PADDING zero bytes so the
+  // parser may look ahead without bounds checks. Escaped strings are
+  // unescaped in place.
+  class Buffer {
+  public:
+    static constexpr size_t PADDING = 64;
+
+    static Buffer Read(std::istream& input);
+    // Maps the file when its last page has room for the padding
+    static Buffer ReadFile(const std::string& file_name);
+
+    Buffer() = default;
+    Buffer(Buffer&& other) noexcept;
+    Buffer& operator=(Buffer&& other) noexcept;
+    ~Buffer();
+
+    char* Data() { return data_; }
+    size_t Size() const { return size_; }
+
+  private:
+    std::vector<char> owned_;
+    char* data_ = nullptr;
+    size_t size_ = 0;
+    size_t mapped_size_ = 0; // nonzero if data_ is a mapping of a file
+  };
+
   class Document {
   public:
     explicit Document(Node root);
+    Document(Buffer buffer, Node root);
 
     const Node& GetRoot() const;
 
   private:
+    Buffer buffer;
     Node root;
   };
 
+  // Pull reader: walks a document in order without building its tree.
+  // Objects and arrays are entered and stepped through member by member;
+  // any value may also be read whole as a Node. Strings are views into the
+  // buffer, valid as long as the reader.
+  class Reader {
+  public:
+    explicit Reader(Buffer buffer);
+
+    void EnterObject();
+    // Key of the next member of the object last entered, nullopt at its end
+    std::optional<std::string_view> NextKey();
+    void EnterArray();
+    // Whether the array last entered has another element
+    bool NextElement();
+
+    Node ReadNode();
+    std::string_view ReadString();
+    int ReadInt();
+    double ReadDouble();
+    bool ReadBool();
+    void Skip();
+
+  private:
+    Buffer buffer_;
+    StructuralIndex index_;
+    bool first_ = false; // nothing taken yet from the object or array just entered
+  };
+
+  // Streaming counterpart of Reader: text is appended to a reusable buffer
+  // and handed to the stream in large writes, when the buffer fills and on
+  // Flush or destruction. Separators are put in by the writer, and strings
+  // and keys are escaped.
+  class Writer {
+  public:
+    static constexpr size_t BUFFER_SIZE = 1 << 16;
+
+    explicit Writer(std::ostream& output);
+    Writer(const Writer&) = delete;
+    Writer& operator=(const Writer&) = delete;
+    ~Writer();
+
+    void BeginObject();
+    void EndObject();
+    // Key of the next member of the object last begun
+    void Key(std::string_view key);
+    void BeginArray();
+    void EndArray();
+
+    void WriteNode(const Node& node);
+    void WriteString(std::string_view value);
+    void WriteInt(int value);
+    void WriteDouble(double value);
+    void WriteBool(bool value);
+    // Text already in JSON form: WriteRaw writes it as a value, Append
+    // continues the value last written
+    void WriteRaw(std::string_view text);
+    void Append(std::string_view text);
+    void Append(int value);
+
+    void Flush();
+
+  private:
+    std::ostream& output_;
+    std::vector<char> buffer_;
+    size_t size_ = 0;
+    bool first_ = true; // nothing written yet into the object or array just begun
+    bool after_key_ = false;
+
+    void BeginValue();
+    void AppendQuoted(std::string_view text);
+    template <typename Format>
+    void AppendFormatted(Format format);
+  };
+
+  Document Load(Buffer buffer);
   Document Load(std::istream& input);
   void Print(const Document& doc, std::ostream& output);
 
@@ -9,6 +9,8 @@
 #include <algorithm>
 #include <iterator>
 #include <optional>
+#include <sstream>
+#include <utility>
 #include <variant>
 #include <stdexcept>
 
@@ -17,83 +19,143 @@ using namespace Json;
 
 namespace JsonArgs {
 
-InCommand ReadInputCommand(const Node& node) {
-  auto command = node.AsMap();
-  auto type = command["type"].AsString();
-  if (type == "Stop") {
-    auto stop_name = command["name"].AsString();
-    double latitude = command["latitude"].AsDouble();
-    double longitude = command["longitude"].AsDouble();
-
-    std::unordered_map<std::string, unsigned int> distances;
-    auto distances_nodes = command["road_distances"].AsMap();
-    for (const auto& [to, road_length] : distances_nodes) {
-      distances[to] = static_cast<unsigned int>(road_length.AsInt());
-    }
-
-    return NewStopCommand{string{stop_name}, latitude, longitude, distances};
-  } else if (type == "Bus") {
-    auto route_number = command["name"].AsString();
-
-    vector<string> stops;
-    auto stop_nodes = command["stops"].AsArray();
-    transform(begin(stop_nodes), end(stop_nodes),
-              back_inserter(stops),
-              [](const Node& n) { return n.AsString(); });
-    auto is_roundtrip = command["is_roundtrip"].AsBool();
-    return NewBusCommand{route_number, stops, is_roundtrip};
-  } else {
-    throw invalid_argument("Unsupported command");
+// Members of a request may come in any order, so they are collected before
+// the request is handled; views point into the reader's buffer. Members
+// left empty were missing from the request.
+struct BaseRequest {
+  optional<string_view> type;
+  optional<string_view> name;
+  optional<double> latitude;
+  optional<double> longitude;
+  vector<pair<string_view, unsigned int>> road_distances;
+  optional<vector<string_view>> stops;
+  optional<bool> is_roundtrip;
+};
+
+template <typename Value>
+static const Value& Required(const optional<Value>& value, string_view key) {
+  if (!value) {
+    throw invalid_argument("Missing " + string{key} + " in base request");
   }
+  return *value;
 }
 
-OutCommand ReadOutputCommand(const Node& node) {
-  auto command = node.AsMap();
-  auto type = command["type"].AsString();
-  auto request_id = command["id"].AsInt();
-  if (type == "Stop") {
-    auto stop_name = command["name"].AsString();
-    return StopDescriptionCommand{stop_name, request_id};
-  } else if (type == "Bus") {
-    auto route_number = command["name"].AsString();
-    return BusDescriptionCommand{route_number, request_id};
-  } else if (type == "Route") {
-    auto from = command["from"].AsString();
-    auto to = command["to"].AsString();
-    return RouteCommand{from, to, request_id};
-  } else if (type == "Map") {
-    return MapCommand{request_id};
-  } else {
-    throw invalid_argument("Unsupported command");
-  }
-}
+static void ReadBaseRequests(Reader& reader, TransportManager& manager) {
+  reader.EnterArray();
+  while (reader.NextElement()) {
+    BaseRequest request;
+    reader.EnterObject();
+    while (const auto key = reader.NextKey()) {
+      if (*key == "type") {
+        request.type = reader.ReadString();
+      } else if (*key == "name") {
+        request.name = reader.ReadString();
+      } else if (*key == "latitude") {
+        request.latitude = reader.ReadDouble();
+      } else if (*key == "longitude") {
+        request.longitude = reader.ReadDouble();
+      } else if (*key == "road_distances") {
+        reader.EnterObject();
+        while (const auto to = reader.NextKey()) {
+          request.road_distances.emplace_back(*to, static_cast<unsigned int>(reader.ReadInt()));
+        }
+      } else if (*key == "stops") {
+        request.stops.emplace();
+        reader.EnterArray();
+        while (reader.NextElement()) {
+          request.stops->push_back(reader.ReadString());
+        }
+      } else if (*key == "is_roundtrip") {
+        request.is_roundtrip = reader.ReadBool();
+      } else {
+        reader.Skip();
+      }
+    }
 
-static vector<InCommand> ParseBaseRequests(const vector<Node>& base_request_nodes) {
-  vector<InCommand> base_requests;
-  for (const auto& node : base_request_nodes) {
-    base_requests.push_back(ReadInputCommand(node));
+    const string_view type = Required(request.type, "type");
+    if (type == "Stop") {
+      manager.AddStop(string{Required(request.name, "name")},
+                      Required(request.latitude, "latitude"),
+                      Required(request.longitude, "longitude"),
+                      request.road_distances);
+    } else if (type == "Bus") {
+      const auto& stops = Required(request.stops, "stops");
+      manager.AddBus(string{Required(request.name, "name")},
+                     vector<string>(begin(stops), end(stops)),
+                     Required(request.is_roundtrip, "is_roundtrip"));
+    } else {
+      throw invalid_argument("Unsupported command");
+    }
   }
-  return base_requests;
 }
 
-static vector<OutCommand> ParseStatRequests(const vector<Node>& stat_request_nodes) {
+static vector<OutCommand> ReadStatRequests(Reader& reader) {
   vector<OutCommand> stat_requests;
-  for (const auto& node : stat_request_nodes) {
-    stat_requests.push_back(ReadOutputCommand(node));
+  reader.EnterArray();
+  while (reader.NextElement()) {
+    string_view type;
+    int request_id = 0;
+    string_view name;
+    string_view from;
+    string_view to;
+
+    reader.EnterObject();
+    while (const auto key = reader.NextKey()) {
+      if (*key == "type") {
+        type = reader.ReadString();
+      } else if (*key == "id") {
+        request_id = reader.ReadInt();
+      } else if (*key == "name") {
+        name = reader.ReadString();
+      } else if (*key == "from") {
+        from = reader.ReadString();
+      } else if (*key == "to") {
+        to = reader.ReadString();
+      } else {
+        reader.Skip();
+      }
+    }
+
+    if (type == "Stop") {
+      stat_requests.push_back(StopDescriptionCommand{string{name}, request_id});
+    } else if (type == "Bus") {
+      stat_requests.push_back(BusDescriptionCommand{string{name}, request_id});
+    } else if (type == "Route") {
+      stat_requests.push_back(RouteCommand{string{from}, string{to}, request_id});
+    } else if (type == "Map") {
+      stat_requests.push_back(MapCommand{request_id});
+    } else {
+      throw invalid_argument("Unsupported command");
+    }
   }
   return stat_requests;
 }
 
-static RoutingSettings ParseRoutingSettings(const map<string, Node>& routing_settings_node) {
+static RoutingSettings ParseRoutingSettings(const Dict& routing_settings_node) {
   return {
     static_cast<unsigned int>(routing_settings_node.at("bus_wait_time").AsInt()),
     routing_settings_node.at("bus_velocity").AsDouble(),
+    routing_settings_node.count("router")
+      ? ROUTER_ENGINES.at(string{routing_settings_node.at("router").AsString()})
+      : RouterEngine::DIJKSTRA,
+    routing_settings_node.count("build_threads")
+      ? static_cast<unsigned int>(routing_settings_node.at("build_threads").AsInt())
+      : 0u,
+    routing_settings_node.count("routing_mode")
+      ? ROUTING_MODES.at(string{routing_settings_node.at("routing_mode").AsString()})
+      : RoutingMode::ALL_PAIRS,
+    routing_settings_node.count("graph_model")
+      ? GRAPH_MODELS.at(string{routing_settings_node.at("graph_model").AsString()})
+      : GraphModel::STOP_PAIRS,
+    routing_settings_node.count("landmark_count")
+      ? static_cast<unsigned int>(routing_settings_node.at("landmark_count").AsInt())
+      : 8u,
   };
 }
 
 static Svg::Color ParseColor(const Node& node) {
   if (node.IsArray()) {
-    const auto color_array = node.AsArray();
+    const auto& color_array = node.AsArray();
     if (color_array.size() == 4) {
       return Svg::Rgba{
         static_cast<uint8_t>(color_array[0].AsInt()),
@@ -111,11 +173,11 @@ static Svg::Color ParseColor(const Node& node) {
     }
   }
   else {
-    return node.AsString();
+    return string{node.AsString()};
   }
 }
 
-static RenderSettings ParseRenderSettings(const map<string, Node>& render_settings_node) {
+static RenderSettings ParseRenderSettings(const Dict& render_settings_node) {
   RenderSettings render_settings;
 
   render_settings.width = render_settings_node.at("width").AsDouble();
@@ -125,7 +187,7 @@ static RenderSettings ParseRenderSettings(const map<string, Node>& render_settin
   render_settings.line_width = render_settings_node.at("line_width").AsDouble();
   render_settings.stop_label_font_size = render_settings_node.at("stop_label_font_size").AsInt();
 
-  const auto stop_label_offset_node = render_settings_node.at("stop_label_offset").AsArray();
+  const auto& stop_label_offset_node = render_settings_node.at("stop_label_offset").AsArray();
   render_settings.stop_label_offset = Svg::Point{stop_label_offset_node[0].AsDouble(),
                                                  stop_label_offset_node[1].AsDouble() };
 
@@ -133,160 +195,227 @@ static RenderSettings ParseRenderSettings(const map<string, Node>& render_settin
   render_settings.underlayer_width = render_settings_node.at("underlayer_width").AsDouble();
   render_settings.outer_margin = render_settings_node.at("outer_margin").AsDouble();
 
-  const auto color_palette_node = render_settings_node.at("color_palette").AsArray();
+  const auto& color_palette_node = render_settings_node.at("color_palette").AsArray();
   std::transform(begin(color_palette_node), end(color_palette_node),
                  back_inserter(render_settings.color_palette),
                  ParseColor);
 
   render_settings.bus_label_font_size = render_settings_node.at("bus_label_font_size").AsInt();
 
-  const auto bus_label_offset_node = render_settings_node.at("bus_label_offset").AsArray();
+  const auto& bus_label_offset_node = render_settings_node.at("bus_label_offset").AsArray();
   render_settings.bus_label_offset = Svg::Point{bus_label_offset_node[0].AsDouble(),
                                                 bus_label_offset_node[1].AsDouble() };
 
-  const auto layers_node = render_settings_node.at("layers").AsArray();
+  const auto& layers_node = render_settings_node.at("layers").AsArray();
   for (const auto& layer_item : layers_node) {
-    render_settings.layers.push_back(MAP_LAYERS.at(layer_item.AsString()));
+    render_settings.layers.push_back(MAP_LAYERS.at(string{layer_item.AsString()}));
   }
 
   return render_settings;
 }
 
-static SerializationSettings ParseSerializationSettings(const map<string, Node>& serialization_settings_node) {
+static SerializationSettings ParseSerializationSettings(const Dict& serialization_settings_node) {
   return {
-    serialization_settings_node.at("file").AsString(),
+    string{serialization_settings_node.at("file").AsString()},
+    serialization_settings_node.count("format")
+      ? BASE_FORMATS.at(string{serialization_settings_node.at("format").AsString()})
+      : BaseFormat::PROTOBUF,
+    serialization_settings_node.count("memory_budget_mb")
+      ? static_cast<size_t>(serialization_settings_node.at("memory_budget_mb").AsInt())
+      : 0u,
+    serialization_settings_node.count("route_cache_size")
+      ? static_cast<size_t>(serialization_settings_node.at("route_cache_size").AsInt())
+      : 1024u,
+    serialization_settings_node.count("previous_file")
+      ? string{serialization_settings_node.at("previous_file").AsString()}
+      : string{},
   };
 }
 
-TransportManagerCommands ReadCommands(istream& s) {
-  auto root = Load(s).GetRoot().AsMap();
-
-  auto base_requests = ParseBaseRequests(
-      root.count("base_requests") ? root.at("base_requests").AsArray() : vector<Node>{}
-  );
+// Settings are small and read as trees; requests are read member by member
+static vector<OutCommand> ReadRequests(Buffer buffer, TransportManager& manager) {
+  Reader reader(move(buffer));
+  vector<OutCommand> stat_requests;
 
-  auto stat_requests = ParseStatRequests(
-      root.count("stat_requests") ? root.at("stat_requests").AsArray() : vector<Node>{}
-  );
+  reader.EnterObject();
+  while (const auto key = reader.NextKey()) {
+    if (*key == "base_requests") {
+      ReadBaseRequests(reader, manager);
+    } else if (*key == "stat_requests") {
+      stat_requests = ReadStatRequests(reader);
+    } else if (*key == "routing_settings") {
+      manager.SetRoutingSettings(ParseRoutingSettings(reader.ReadNode().AsMap()));
+    } else if (*key == "render_settings") {
+      manager.SetRenderSettings(ParseRenderSettings(reader.ReadNode().AsMap()));
+    } else if (*key == "serialization_settings") {
+      manager.SetSerializationSettings(ParseSerializationSettings(reader.ReadNode().AsMap()));
+    } else {
+      reader.Skip();
+    }
+  }
 
-  auto routing_settings = root.count("routing_settings")
-    ? ParseRoutingSettings(root.at("routing_settings").AsMap())
-    : RoutingSettings{};
+  return stat_requests;
+}
 
-  auto render_settings = root.count("render_settings")
-    ? ParseRenderSettings(root.at("render_settings").AsMap())
-    : RenderSettings{};
+vector<OutCommand> ReadRequests(istream& input, TransportManager& manager) {
+  return ReadRequests(Buffer::Read(input), manager);
+}
 
-  auto serialization_settings = ParseSerializationSettings(
-    root.count("serialization_settings") ? root.at("serialization_settings").AsMap() : map<string, Node>{}
-  );
+vector<OutCommand> ReadRequests(const string& file_name, TransportManager& manager) {
+  return ReadRequests(Buffer::ReadFile(file_name), manager);
+}
 
-  return TransportManagerCommands{
-    base_requests,
-    stat_requests,
-    routing_settings,
-    render_settings,
-    serialization_settings,
-  };
+// Keys are written in sorted order, as Print has them for a Dict
+static void WriteBusResponse(Writer& writer, const BusInfo& bus, int request_id) {
+  writer.BeginObject();
+  if (bus.error_message.has_value()) {
+    writer.Key("error_message");
+    writer.WriteString(bus.error_message.value());
+    writer.Key("request_id");
+    writer.WriteInt(request_id);
+  }
+  else {
+    writer.Key("curvature");
+    writer.WriteDouble(bus.curvature);
+    writer.Key("request_id");
+    writer.WriteInt(request_id);
+    writer.Key("route_length");
+    writer.WriteInt(static_cast<int>(bus.route_length));
+    writer.Key("stop_count");
+    writer.WriteInt(static_cast<int>(bus.stop_count));
+    writer.Key("unique_stop_count");
+    writer.WriteInt(static_cast<int>(bus.unique_stop_count));
+  }
+  writer.EndObject();
 }
 
-//static std::string InsertEscapeCharacter(std::string str) {
-//  for (auto it = begin(str); it != end(str); ++it) {
-//    if (*it == '"' || *it == '\\') {
-//      it = str.insert(it, '\\');
-//      if (it != end(str)) {
-//        ++it;
-//      }
-//    }
-//  }
-//  return str;
-//}
-
-void PrintResults(std::ostream& output, const std::vector<StopInfo>& stop_info, const std::vector<BusInfo>& bus_info, const std::vector<RouteInfo>& route_data, const std::vector<MapDescription>& maps) {
-  vector<Node> result;
-
-  for (const auto& bus : bus_info) {
-    map<string, Node> bus_dict = {
-      {"request_id", Node(bus.request_id)},
-    };
-
-    if (bus.error_message.has_value()) {
-      bus_dict["error_message"] = Node(bus.error_message.value());
-    }
-    else {
-      bus_dict["route_length"] = Node(static_cast<int>(bus.route_length));
-      bus_dict["curvature"] = Node(bus.curvature);
-      bus_dict["stop_count"] = Node(static_cast<int>(bus.stop_count));
-      bus_dict["unique_stop_count"] = Node(static_cast<int>(bus.unique_stop_count));
+static void WriteStopResponse(Writer& writer, const StopInfo& stop, int request_id) {
+  writer.BeginObject();
+  if (stop.error_message.has_value()) {
+    writer.Key("error_message");
+    writer.WriteString(stop.error_message.value());
+  }
+  else {
+    writer.Key("buses");
+    writer.BeginArray();
+    for (const auto& route_number : stop.buses) {
+      writer.WriteString(route_number);
     }
-    result.push_back(Node(bus_dict));
+    writer.EndArray();
   }
+  writer.Key("request_id");
+  writer.WriteInt(request_id);
+  writer.EndObject();
+}
 
-  for (const auto& stop : stop_info) {
-    map<string, Node> stop_dict = {
-      {"request_id", Node(stop.request_id)},
-    };
+// Prints the response with a zero request id and cuts the id out; nothing
+// but numbers follows the id in these responses, so its key is found last
+template <typename Info>
+static pair<string, size_t> RenderWithoutRequestId(const Info& info, void (*write_response)(Writer&, const Info&, int)) {
+  ostringstream output;
+  {
+    Writer writer(output);
+    write_response(writer, info, 0);
+  }
+  string body = output.str();
 
-    if (stop.error_message.has_value()) {
-      stop_dict["error_message"] = Node(stop.error_message.value());
-    }
-    else {
-      vector<Node> buses;
-      transform(begin(stop.buses), end(stop.buses),
-                back_inserter(buses),
-                [](const string& route_number) { return Node(route_number); });
+  const string request_id_key = "\"request_id\": ";
+  const size_t offset = body.rfind(request_id_key) + request_id_key.size();
+  body.erase(offset, 1);
+  return {move(body), offset};
+}
 
-      stop_dict["buses"] = Node(buses);
-    }
-    result.push_back(Node(move(stop_dict)));
+pair<string, size_t> RenderStopResponse(const StopInfo& stop) {
+  return RenderWithoutRequestId(stop, WriteStopResponse);
+}
+
+pair<string, size_t> RenderBusResponse(const BusInfo& bus) {
+  return RenderWithoutRequestId(bus, WriteBusResponse);
+}
+
+ResponsePrinter::ResponsePrinter(ostream& output)
+  : writer_(output)
+{
+  writer_.BeginArray();
+}
+
+// Responses rendered by make_base are spliced in as text
+void ResponsePrinter::PrintRendered(const RenderedResponse& response, int request_id) {
+  writer_.WriteRaw(response.body.substr(0, response.request_id_offset));
+  writer_.Append(request_id);
+  writer_.Append(response.body.substr(response.request_id_offset));
+}
+
+void ResponsePrinter::Print(const StopInfo& stop) {
+  if (stop.rendered) {
+    PrintRendered(*stop.rendered, stop.request_id);
+  } else {
+    WriteStopResponse(writer_, stop, stop.request_id);
   }
+}
 
-  for (const auto& route : route_data) {
-    map<string, Node> route_dict = {
-      {"request_id", Node(route.request_id)},
-    };
+void ResponsePrinter::Print(const BusInfo& bus) {
+  if (bus.rendered) {
+    PrintRendered(*bus.rendered, bus.request_id);
+  } else {
+    WriteBusResponse(writer_, bus, bus.request_id);
+  }
+}
 
-    if (route.error_message.has_value()) {
-      route_dict["error_message"] = Node(route.error_message.value());
-    }
-    else {
-      vector<Node> items;
-      for (const auto& item : route.items) {
-        map<string, Node> activity_node;
-        if (holds_alternative<WaitActivity>(item)) {
-          auto wait_activity = get<WaitActivity>(item);
-          activity_node["type"] = wait_activity.type;
-          activity_node["time"] = static_cast<int>(wait_activity.time);
-          activity_node["stop_name"] = wait_activity.stop_name;
-        }
-        else {
-          auto bus_activity = get<BusActivity>(item);
-          activity_node["type"] = bus_activity.type;
-          activity_node["time"] = static_cast<double>(bus_activity.time);
-          activity_node["bus"] = bus_activity.bus;
-          activity_node["span_count"] = static_cast<int>(bus_activity.span_count);
-        }
-        items.push_back(activity_node);
+void ResponsePrinter::Print(const RouteInfo& route) {
+  writer_.BeginObject();
+  if (route.error_message.has_value()) {
+    writer_.Key("error_message");
+    writer_.WriteString(route.error_message.value());
+    writer_.Key("request_id");
+    writer_.WriteInt(route.request_id);
+  }
+  else {
+    writer_.Key("items");
+    writer_.BeginArray();
+    for (const auto& item : route.items) {
+      writer_.BeginObject();
+      if (holds_alternative<WaitActivity>(item)) {
+        const auto& wait_activity = get<WaitActivity>(item);
+        writer_.Key("stop_name");
+        writer_.WriteString(wait_activity.stop_name);
+        writer_.Key("time");
+        writer_.WriteInt(static_cast<int>(wait_activity.time));
+        writer_.Key("type");
+        writer_.WriteString("Wait");
       }
-      route_dict["items"] = items;
-      route_dict["total_time"] = route.total_time;
-      // route_dict["map"] = Node(InsertEscapeCharacter(route.svg_map)); // TODO: uncomment this
+      else {
+        const auto& bus_activity = get<BusActivity>(item);
+        writer_.Key("bus");
+        writer_.WriteString(bus_activity.bus);
+        writer_.Key("span_count");
+        writer_.WriteInt(static_cast<int>(bus_activity.span_count));
+        writer_.Key("time");
+        writer_.WriteDouble(bus_activity.time);
+        writer_.Key("type");
+        writer_.WriteString("Bus");
+      }
+      writer_.EndObject();
     }
-    result.push_back(Node(route_dict));
-  }
-
-  for (const auto& map_description : maps) {
-    map<string, Node> map_dict = {
-      {"request_id", Node(map_description.request_id)},
-      //{"map", Node(InsertEscapeCharacter(map_description.svg_map))},
-    };
-    result.push_back(Node(map_dict));
+    writer_.EndArray();
+    writer_.Key("request_id");
+    writer_.WriteInt(route.request_id);
+    writer_.Key("total_time");
+    writer_.WriteDouble(route.total_time);
   }
+  writer_.EndObject();
+}
 
-  Node root{result};
-  Document doc{root};
+void ResponsePrinter::Print(const MapDescription& map_description) {
+  writer_.BeginObject();
+  writer_.Key("request_id");
+  writer_.WriteInt(map_description.request_id);
+  writer_.EndObject();
+}
 
-  Print(doc, output);
+void ResponsePrinter::Finish() {
+  writer_.EndArray();
+  writer_.Flush();
 }
 
 } // namespace JsonArgs
@@ -1,15 +1,46 @@
 #pragma once
 
+#include "json.h"
 #include "transport_manager_command.h"
 
 #include <memory>
+#include <string>
 #include <string_view>
+#include <utility>
 #include <iostream>
 #include <vector>
 
+class TransportManager;
+
 namespace JsonArgs {
 
-TransportManagerCommands ReadCommands(std::istream& s);
-void PrintResults(std::ostream& output, const std::vector<StopInfo>& stop_info, const std::vector<BusInfo>& bus_info, const std::vector<RouteInfo>& route_data, const std::vector<MapDescription>& maps);
+// Reads the requests in one pass: settings and base requests are handed to
+// the manager as they are read, stat requests are returned to be answered
+// once the base is loaded
+std::vector<OutCommand> ReadRequests(std::istream& input, TransportManager& manager);
+std::vector<OutCommand> ReadRequests(const std::string& file_name, TransportManager& manager);
+// Stop and Bus responses without the request id, followed by the offset it
+// goes at, for make_base to store
+std::pair<std::string, size_t> RenderStopResponse(const StopInfo& stop);
+std::pair<std::string, size_t> RenderBusResponse(const BusInfo& bus);
+
+// Prints responses into one JSON array as soon as each is computed, in the
+// order given
+class ResponsePrinter {
+public:
+  explicit ResponsePrinter(std::ostream& output);
+
+  void Print(const StopInfo& stop);
+  void Print(const BusInfo& bus);
+  void Print(const RouteInfo& route);
+  void Print(const MapDescription& map_description);
+  // Closes the array and flushes it to the stream
+  void Finish();
+
+private:
+  Json::Writer writer_;
+
+  void PrintRendered(const RenderedResponse& response, int request_id);
+};
 
 } // namespace JsonArgs 
@@ -0,0 +1,182 @@
+#include "json_index.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define JSON_INDEX_X86
+#endif
+
+using namespace std;
+
+namespace Json {
+
+namespace {
+
+constexpr size_t BLOCK_SIZE = 64;
+// Blocks classified per kernel call
+constexpr size_t CHUNK_BLOCKS = 64;
+
+// Bit i of a mask stands for byte i of a block
+struct BlockMasks {
+  uint64_t quote;
+  uint64_t backslash;
+  uint64_t op;
+  uint64_t space;
+};
+
+using ClassifyKernel = void (*)(const char* data, size_t block_count, BlockMasks* masks);
+
+void ClassifyBlocksScalar(const char* data, size_t block_count, BlockMasks* masks) {
+  for (size_t block = 0; block < block_count; ++block) {
+    BlockMasks& block_masks = masks[block];
+    block_masks = {};
+    for (size_t i = 0; i < BLOCK_SIZE; ++i) {
+      const uint64_t bit = uint64_t{1} << i;
+      switch (data[BLOCK_SIZE * block + i]) {
+        case '"': block_masks.quote |= bit; break;
+        case '\\': block_masks.backslash |= bit; break;
+        case '{': case '}': case '[': case ']': case ':': case ',': block_masks.op |= bit; break;
+        case ' ': case '\n': case '\r': case '\t': block_masks.space |= bit; break;
+      }
+    }
+  }
+}
+
+#if defined(JSON_INDEX_X86)
+struct HalfMasks {
+  uint32_t quote;
+  uint32_t backslash;
+  uint32_t op;
+  uint32_t space;
+};
+
+__attribute__((target("avx2")))
+uint32_t Mask(__m256i bytes, char c) {
+  return static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(c))));
+}
+
+// Setting bit 5 folds '[' and ']' onto '{' and '}' and no other byte onto them
+__attribute__((target("avx2")))
+HalfMasks ClassifyHalfAvx2(const char* data) {
+  const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+  const __m256i folded = _mm256_or_si256(bytes, _mm256_set1_epi8(0x20));
+  return {
+    Mask(bytes, '"'),
+    Mask(bytes, '\\'),
+    Mask(folded, '{') | Mask(folded, '}') | Mask(bytes, ':') | Mask(bytes, ','),
+    Mask(bytes, ' ') | Mask(bytes, '\n') | Mask(bytes, '\r') | Mask(bytes, '\t'),
+  };
+}
+
+__attribute__((target("avx2")))
+void ClassifyBlocksAvx2(const char* data, size_t block_count, BlockMasks* masks) {
+  for (size_t block = 0; block < block_count; ++block) {
+    const HalfMasks low = ClassifyHalfAvx2(data + BLOCK_SIZE * block);
+    const HalfMasks high = ClassifyHalfAvx2(data + BLOCK_SIZE * block + BLOCK_SIZE / 2);
+    masks[block] = {
+      low.quote | uint64_t{high.quote} << 32,
+      low.backslash | uint64_t{high.backslash} << 32,
+      low.op | uint64_t{high.op} << 32,
+      low.space | uint64_t{high.space} << 32,
+    };
+  }
+}
+#endif
+
+ClassifyKernel SelectClassifyKernel() {
+#if defined(JSON_INDEX_X86)
+  if (__builtin_cpu_supports("avx2")) {
+    return ClassifyBlocksAvx2;
+  }
+#endif
+  return ClassifyBlocksScalar;
+}
+
+const ClassifyKernel classify_kernel = SelectClassifyKernel();
+
+// Characters preceded by an unescaped backslash. Escapes are rare in
+// transport data, so they are resolved bit by bit; escape_carry marks the
+// first byte of the next block as escaped.
+uint64_t FindEscaped(uint64_t backslash, uint64_t& escape_carry) {
+  uint64_t escaped = escape_carry;
+  escape_carry = 0;
+  for (; backslash; backslash &= backslash - 1) {
+    const int i = __builtin_ctzll(backslash);
+    if (escaped >> i & 1) {
+      continue;
+    }
+    if (i == BLOCK_SIZE - 1) {
+      escape_carry = 1;
+    } else {
+      escaped |= uint64_t{2} << i;
+    }
+  }
+  return escaped;
+}
+
+// Bit i is the parity of the set bits up to and including i
+uint64_t PrefixXor(uint64_t bits) {
+  for (size_t shift = 1; shift < BLOCK_SIZE; shift *= 2) {
+    bits ^= bits << shift;
+  }
+  return bits;
+}
+
+}
+
+StructuralIndex::StructuralIndex(const char* data, size_t size)
+  : data_(data)
+  , size_(size)
+  , batch_(CHUNK_BLOCKS * BLOCK_SIZE + 1)
+{
+  if (size >= numeric_limits<uint32_t>::max()) {
+    throw invalid_argument("JSON input too large");
+  }
+}
+
+void StructuralIndex::Refill() {
+  BlockMasks masks[CHUNK_BLOCKS];
+  uint32_t* tokens = batch_.data();
+  next_ = tokens;
+
+  // A batch may come out empty inside a long string
+  while (tokens == next_ && position_ < size_) {
+    const size_t block_count = min(CHUNK_BLOCKS, (size_ - position_ + BLOCK_SIZE - 1) / BLOCK_SIZE);
+    classify_kernel(data_ + position_, block_count, masks);
+
+    for (size_t block = 0; block < block_count; ++block, position_ += BLOCK_SIZE) {
+      const uint64_t valid = size_ - position_ >= BLOCK_SIZE ? ~uint64_t{0} : (uint64_t{1} << (size_ - position_)) - 1;
+      const BlockMasks& block_masks = masks[block];
+
+      // in_string covers an opening quote and the string after it, but not
+      // its closing quote
+      const uint64_t escaped = FindEscaped(block_masks.backslash & valid, escape_carry_);
+      const uint64_t quote = block_masks.quote & ~escaped & valid;
+      const uint64_t in_string = PrefixXor(quote) ^ in_string_carry_;
+      in_string_carry_ = static_cast<uint64_t>(static_cast<int64_t>(in_string) >> (BLOCK_SIZE - 1));
+
+      const uint64_t op = block_masks.op & ~in_string & valid;
+      const uint64_t scalar = ~(block_masks.op | block_masks.space | in_string | quote) & valid;
+      const uint64_t scalar_start = scalar & ~(scalar << 1 | scalar_carry_);
+      scalar_carry_ = scalar >> (BLOCK_SIZE - 1);
+
+      for (uint64_t structurals = op | quote | scalar_start; structurals; structurals &= structurals - 1) {
+        *tokens++ = position_ + __builtin_ctzll(structurals);
+      }
+    }
+  }
+  position_ = min(position_, size_);
+
+  if (tokens == next_) {
+    if (in_string_carry_) {
+      throw invalid_argument("unterminated JSON string");
+    }
+    *tokens++ = size_;
+  }
+  end_ = tokens;
+}
+
+}
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace Json {
+
+  // First pass over JSON text, run ahead of the tree builder in small
+  // batches: the positions of its structural characters ({}[]:, outside
+  // strings), of every unescaped quote, opening and closing, and of the
+  // first byte of every other value, in order. Text is classified 64 bytes
+  // at a time, with AVX2 when the CPU has it and a scalar loop otherwise.
+  class StructuralIndex {
+  public:
+    // data must be readable 64 bytes past size
+    StructuralIndex(const char* data, size_t size);
+
+    // Position of the next token, size once all are taken. Throws
+    // invalid_argument on reaching the end inside a string.
+    uint32_t Next() {
+      if (next_ == end_) {
+        Refill();
+      }
+      return *next_++;
+    }
+    uint32_t Peek() {
+      if (next_ == end_) {
+        Refill();
+      }
+      return *next_;
+    }
+
+  private:
+    const char* data_;
+    size_t size_;
+    size_t position_ = 0; // of the first byte not yet classified
+    uint64_t escape_carry_ = 0;
+    uint64_t in_string_carry_ = 0; // all ones while a string goes on
+    uint64_t scalar_carry_ = 0;
+    std::vector<uint32_t> batch_;
+    const uint32_t* next_ = nullptr;
+    const uint32_t* end_ = nullptr;
+
+    void Refill();
+  };
+
+}
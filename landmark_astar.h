@@ -0,0 +1,224 @@
+#pragma once
+
+#include "dijkstra_router.h"
+#include "graph.h"
+
+#include <algorithm>
+#include <cassert>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <queue>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace Graph {
+
+  // Single-pair A* search. The potential of a vertex is the largest lower
+  // bound on its distance to the target: the caller's distance bound (e.g. a
+  // geographic one) and, for every landmark L, the triangle inequality bounds
+  // d(L, to) - d(L, v) and d(v, L) - d(to, L) over precomputed distances.
+  // Both kinds of bounds are consistent, so every vertex is settled once.
+  template <typename Weight>
+  class LandmarkAStar {
+  private:
+    using Graph = DirectedWeightedGraph<Weight>;
+
+  public:
+    using ExpandedRoute = std::vector<EdgeId>;
+    using DistanceBound = std::function<Weight(VertexId from, VertexId to)>;
+
+    static constexpr Weight UNREACHABLE = std::numeric_limits<Weight>::has_infinity
+        ? std::numeric_limits<Weight>::infinity()
+        : std::numeric_limits<Weight>::max();
+
+    struct Landmark {
+      VertexId vertex;
+      std::vector<Weight> distances_from; // from the landmark to every vertex
+      std::vector<Weight> distances_to;   // from every vertex to the landmark
+    };
+
+    struct Route {
+      Weight weight;
+      ExpandedRoute edges;
+    };
+
+    LandmarkAStar(const Graph& graph, DistanceBound distance_bound, std::vector<Landmark> landmarks);
+
+    // Picks landmarks one by one, each the vertex farthest (by round trip)
+    // from the ones already picked, and computes their distances.
+    static std::vector<Landmark> ChooseLandmarks(const Graph& graph, size_t landmark_count);
+
+    std::optional<Route> FindRoute(VertexId from, VertexId to) const;
+
+    const std::vector<Landmark>& GetLandmarks() const { return landmarks_; }
+
+  private:
+    static constexpr CompactId NO_EDGE = std::numeric_limits<CompactId>::max();
+
+    const Graph& graph_;
+    DistanceBound distance_bound_;
+    std::vector<Landmark> landmarks_;
+
+    struct SearchSpace {
+      std::vector<Weight> distances;
+      std::vector<CompactId> parent_edges;
+      std::vector<CompactId> touched;
+
+      void Reset(size_t vertex_count) {
+        if (distances.size() != vertex_count) {
+          distances.assign(vertex_count, UNREACHABLE);
+          parent_edges.assign(vertex_count, NO_EDGE);
+          touched.clear();
+          return;
+        }
+        for (const CompactId vertex : touched) {
+          distances[vertex] = UNREACHABLE;
+          parent_edges[vertex] = NO_EDGE;
+        }
+        touched.clear();
+      }
+
+      bool Improve(CompactId vertex, Weight distance, CompactId parent_edge) {
+        if (distance >= distances[vertex]) {
+          return false;
+        }
+        if (distances[vertex] == UNREACHABLE) {
+          touched.push_back(vertex);
+        }
+        distances[vertex] = distance;
+        parent_edges[vertex] = parent_edge;
+        return true;
+      }
+    };
+    mutable SearchSpace search_;
+
+    Weight Potential(VertexId vertex, VertexId to) const;
+    static std::vector<Weight> Distances(const Graph& graph, VertexId from);
+  };
+
+
+  template <typename Weight>
+  LandmarkAStar<Weight>::LandmarkAStar(const Graph& graph, DistanceBound distance_bound, std::vector<Landmark> landmarks)
+      : graph_(graph),
+        distance_bound_(std::move(distance_bound)),
+        landmarks_(std::move(landmarks))
+  {
+  }
+
+  template <typename Weight>
+  std::vector<Weight> LandmarkAStar<Weight>::Distances(const Graph& graph, VertexId from) {
+    const auto tree = DijkstraRouter<Weight>{graph}.BuildRouteTree(from);
+    std::vector<Weight> distances;
+    distances.reserve(tree.size());
+    for (const auto& node : tree) {
+      distances.push_back(node ? node->weight : UNREACHABLE);
+    }
+    return distances;
+  }
+
+  template <typename Weight>
+  std::vector<typename LandmarkAStar<Weight>::Landmark> LandmarkAStar<Weight>::ChooseLandmarks(const Graph& graph, size_t landmark_count) {
+    const size_t vertex_count = graph.GetVertexCount();
+    std::vector<Landmark> landmarks;
+    if (vertex_count == 0) {
+      return landmarks;
+    }
+
+    Graph reversed_graph(vertex_count);
+    for (EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+      const auto edge = graph.GetEdge(edge_id);
+      reversed_graph.AddEdge({edge.to, edge.from, edge.weight});
+    }
+    reversed_graph.Freeze();
+
+    // Round trip distance to the nearest landmark; vertices not reachable
+    // both ways score zero and are never picked.
+    std::vector<Weight> scores(vertex_count, UNREACHABLE);
+    auto update_scores = [&](const std::vector<Weight>& distances_from, const std::vector<Weight>& distances_to) {
+      for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
+        const Weight round_trip = distances_from[vertex] == UNREACHABLE || distances_to[vertex] == UNREACHABLE
+            ? 0
+            : distances_from[vertex] + distances_to[vertex];
+        scores[vertex] = std::min(scores[vertex], round_trip);
+      }
+    };
+    update_scores(Distances(graph, 0), Distances(reversed_graph, 0));
+
+    while (landmarks.size() < landmark_count) {
+      const auto farthest = std::max_element(std::begin(scores), std::end(scores));
+      if (*farthest <= 0) {
+        break;
+      }
+      const VertexId vertex = std::distance(std::begin(scores), farthest);
+      landmarks.push_back({vertex, Distances(graph, vertex), Distances(reversed_graph, vertex)});
+      update_scores(landmarks.back().distances_from, landmarks.back().distances_to);
+    }
+
+    return landmarks;
+  }
+
+  template <typename Weight>
+  Weight LandmarkAStar<Weight>::Potential(VertexId vertex, VertexId to) const {
+    Weight bound = distance_bound_ ? distance_bound_(vertex, to) : 0;
+    for (const auto& landmark : landmarks_) {
+      const auto& from_landmark = landmark.distances_from;
+      const auto& to_landmark = landmark.distances_to;
+      if (from_landmark[vertex] != UNREACHABLE && from_landmark[to] != UNREACHABLE) {
+        bound = std::max(bound, from_landmark[to] - from_landmark[vertex]);
+      }
+      if (to_landmark[vertex] != UNREACHABLE && to_landmark[to] != UNREACHABLE) {
+        bound = std::max(bound, to_landmark[vertex] - to_landmark[to]);
+      }
+    }
+    return bound;
+  }
+
+  template <typename Weight>
+  std::optional<typename LandmarkAStar<Weight>::Route> LandmarkAStar<Weight>::FindRoute(VertexId from, VertexId to) const {
+    search_.Reset(graph_.GetVertexCount());
+
+    // Items are (distance + potential, distance, vertex); an item is stale
+    // once its vertex got a smaller distance.
+    using QueueItem = std::tuple<Weight, Weight, CompactId>;
+    std::priority_queue<QueueItem, std::vector<QueueItem>, std::greater<QueueItem>> queue;
+    search_.Improve(from, 0, NO_EDGE);
+    queue.push({Potential(from, to), 0, static_cast<CompactId>(from)});
+
+    while (!queue.empty()) {
+      const auto [key, distance, vertex] = queue.top();
+      queue.pop();
+      if (distance > search_.distances[vertex]) {
+        continue;
+      }
+      if (vertex == to) {
+        break;
+      }
+
+      const auto arcs = graph_.GetIncidentArcs(vertex);
+      for (CompactId arc = arcs.begin; arc < arcs.end; ++arc) {
+        const Weight edge_weight = graph_.GetArcWeight(arc);
+        assert(edge_weight >= 0);
+        const CompactId next = graph_.GetArcTarget(arc);
+        const Weight next_distance = distance + edge_weight;
+        if (search_.Improve(next, next_distance, graph_.GetArcEdge(arc))) {
+          queue.push({next_distance + Potential(next, to), next_distance, next});
+        }
+      }
+    }
+
+    if (search_.distances[to] == UNREACHABLE) {
+      return std::nullopt;
+    }
+
+    Route route{search_.distances[to], {}};
+    for (CompactId edge_id = search_.parent_edges[to]; edge_id != NO_EDGE; edge_id = search_.parent_edges[graph_.GetEdge(edge_id).from]) {
+      route.edges.push_back(edge_id);
+    }
+    std::reverse(std::begin(route.edges), std::end(route.edges));
+    return route;
+  }
+
+}
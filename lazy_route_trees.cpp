@@ -0,0 +1,137 @@
+#include "lazy_route_trees.h"
+
+#include <google/protobuf/io/coded_stream.h>
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/wire_format_lite.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+using namespace google::protobuf;
+using internal::WireFormatLite;
+
+namespace {
+
+const uint32_t INDEX_TAG = WireFormatLite::MakeTag(
+    TransportGuide::TransportCatalog::kRouteTreeIndexFieldNumber, WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+const uint32_t TREE_TAG = WireFormatLite::MakeTag(
+    TransportGuide::TransportCatalog::kRouteTreesFieldNumber, WireFormatLite::WIRETYPE_LENGTH_DELIMITED);
+
+}
+
+void LazyRouteTrees::WriteBase(const TransportGuide::TransportCatalog& catalog, const vector<uint32_t>& tree_sizes,
+                               const RouteTreeSource& route_trees, ostream& out) {
+  // All index fields are fixed width, so its size depends on the tree count only
+  TransportGuide::RouteTreeIndex index;
+  index.set_catalog_offset(1);
+  index.set_catalog_size(1);
+  index.mutable_tree_offset()->Resize(tree_sizes.size(), 1);
+  index.mutable_tree_size()->Resize(tree_sizes.size(), 1);
+  const size_t index_size = index.ByteSizeLong();
+
+  uint64_t offset = io::CodedOutputStream::VarintSize32(INDEX_TAG)
+      + io::CodedOutputStream::VarintSize64(index_size) + index_size;
+  index.set_catalog_offset(offset);
+  index.set_catalog_size(catalog.ByteSizeLong());
+  offset += index.catalog_size();
+  for (size_t i = 0; i < tree_sizes.size(); ++i) {
+    offset += io::CodedOutputStream::VarintSize32(TREE_TAG) + io::CodedOutputStream::VarintSize32(tree_sizes[i]);
+    index.set_tree_offset(i, offset);
+    index.set_tree_size(i, tree_sizes[i]);
+    offset += tree_sizes[i];
+  }
+
+  if (index.ByteSizeLong() != index_size) {
+    throw logic_error("route tree index size changed");
+  }
+
+  io::OstreamOutputStream output(&out);
+  io::CodedOutputStream coded_output(&output);
+  coded_output.WriteTag(INDEX_TAG);
+  coded_output.WriteVarint64(index_size);
+  index.SerializeWithCachedSizes(&coded_output);
+  catalog.SerializeWithCachedSizes(&coded_output);
+  route_trees([&](const TransportGuide::RouteTree& tree) {
+    coded_output.WriteTag(TREE_TAG);
+    coded_output.WriteVarint32(tree.ByteSizeLong());
+    tree.SerializeWithCachedSizes(&coded_output);
+  });
+}
+
+unique_ptr<LazyRouteTrees> LazyRouteTrees::Open(const string& file_name, size_t cache_size,
+                                                TransportGuide::TransportCatalog& catalog) {
+  ifstream in_file(file_name, ios::binary);
+  auto index = ReadIndex(in_file, file_name);
+  if (!index) {
+    return nullptr;
+  }
+
+  in_file.clear();
+  in_file.seekg(index->catalog_offset());
+  {
+    io::IstreamInputStream input(&in_file);
+    if (!catalog.ParseFromBoundedZeroCopyStream(&input, index->catalog_size())) {
+      throw runtime_error("invalid base file " + file_name);
+    }
+  }
+
+  return unique_ptr<LazyRouteTrees>(new LazyRouteTrees(move(in_file), move(*index), cache_size));
+}
+
+optional<uint64_t> LazyRouteTrees::CatalogSize(const string& file_name) {
+  ifstream in_file(file_name, ios::binary);
+  const auto index = ReadIndex(in_file, file_name);
+  return index ? optional{index->catalog_size()} : nullopt;
+}
+
+optional<TransportGuide::RouteTreeIndex> LazyRouteTrees::ReadIndex(ifstream& in_file, const string& file_name) {
+  io::IstreamInputStream input(&in_file);
+  io::CodedInputStream coded_input(&input);
+  uint32_t index_size = 0;
+  if (coded_input.ReadTag() != INDEX_TAG || !coded_input.ReadVarint32(&index_size)) {
+    return nullopt;
+  }
+  TransportGuide::RouteTreeIndex index;
+  const auto limit = coded_input.PushLimit(index_size);
+  if (!index.ParseFromCodedStream(&coded_input) || !coded_input.ConsumedEntireMessage()) {
+    throw runtime_error("invalid route tree index in " + file_name);
+  }
+  coded_input.PopLimit(limit);
+  return index;
+}
+
+LazyRouteTrees::LazyRouteTrees(ifstream in_file, TransportGuide::RouteTreeIndex index, size_t cache_size)
+  : in_file_(move(in_file))
+  , index_(move(index))
+  , cache_size_(max<size_t>(cache_size, 1))
+{
+}
+
+const TransportGuide::RouteTree& LazyRouteTrees::Get(size_t stop_id) {
+  if (const auto it = cached_trees_.find(stop_id); it != cached_trees_.end()) {
+    cache_.splice(cache_.begin(), cache_, it->second);
+    return it->second->second;
+  }
+
+  if (cache_.size() == cache_size_) {
+    cached_trees_.erase(cache_.back().first);
+    cache_.pop_back();
+  }
+
+  cache_.emplace_front(stop_id, Read(stop_id));
+  cached_trees_[stop_id] = cache_.begin();
+  return cache_.front().second;
+}
+
+TransportGuide::RouteTree LazyRouteTrees::Read(size_t stop_id) {
+  string tree_data(index_.tree_size(stop_id), '\0');
+  in_file_.clear();
+  in_file_.seekg(index_.tree_offset(stop_id));
+  in_file_.read(tree_data.data(), tree_data.size());
+  TransportGuide::RouteTree tree;
+  if (!in_file_ || !tree.ParseFromString(tree_data)) {
+    throw runtime_error("cannot read route tree of stop " + to_string(stop_id));
+  }
+  return tree;
+}
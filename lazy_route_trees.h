@@ -0,0 +1,53 @@
+#pragma once
+
+#include "route_tree_spill.h"
+#include "transport_catalog.pb.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Route trees of a protobuf base decoded one source stop at a time. The base
+// starts with a RouteTreeIndex; the rest of the catalog and the route trees
+// follow as regular fields, so the file still parses as a whole. Decoded
+// trees are kept in a cache of bounded size, evicting the least recently
+// used one.
+class LazyRouteTrees {
+public:
+  static void WriteBase(const TransportGuide::TransportCatalog& catalog, const std::vector<uint32_t>& tree_sizes,
+                        const RouteTreeSource& route_trees, std::ostream& out);
+
+  // Parses the catalog without its route trees into catalog; returns nullptr
+  // if the file has no route tree index
+  static std::unique_ptr<LazyRouteTrees> Open(const std::string& file_name, size_t cache_size,
+                                              TransportGuide::TransportCatalog& catalog);
+
+  // Serialized size of the catalog without its route trees, if the file has
+  // a route tree index
+  static std::optional<uint64_t> CatalogSize(const std::string& file_name);
+
+  const TransportGuide::RouteTree& Get(size_t stop_id);
+  // Reads the tree past the cache
+  TransportGuide::RouteTree Read(size_t stop_id);
+
+private:
+  using CacheEntry = std::pair<size_t, TransportGuide::RouteTree>;
+
+  std::ifstream in_file_;
+  TransportGuide::RouteTreeIndex index_;
+  size_t cache_size_;
+  std::list<CacheEntry> cache_;
+  std::unordered_map<size_t, std::list<CacheEntry>::iterator> cached_trees_;
+
+  LazyRouteTrees(std::ifstream in_file, TransportGuide::RouteTreeIndex index, size_t cache_size);
+
+  static std::optional<TransportGuide::RouteTreeIndex> ReadIndex(std::ifstream& in_file, const std::string& file_name);
+};
@@ -203,7 +203,7 @@ void MapBuilder::BuildBusLinesOnRoute(Svg::Document &doc, const RouteInfo::Route
   for (const auto& activity : route) {
     if (holds_alternative<BusActivity>(activity)) {
       auto bus_activity = get<BusActivity>(activity);
-      const auto& bus = buses_.at(bus_activity.bus);
+      const auto& bus = buses_.at(string(bus_activity.bus));
 
       vector<string> bus_stops;
       copy_n(
@@ -275,7 +275,7 @@ void MapBuilder::BuildBusLabelsOnRoute(Svg::Document& doc, const RouteInfo::Rout
   for (const auto& activity : route) {
     if (holds_alternative<BusActivity>(activity)) {
       auto bus_activity = get<BusActivity>(activity);
-      const auto& bus = buses_.at(bus_activity.bus);
+      const auto& bus = buses_.at(string(bus_activity.bus));
 
       vector<Svg::Point> points;
 
@@ -322,7 +322,7 @@ void MapBuilder::BuildStopPointsOnRoute(Svg::Document& doc, const RouteInfo::Rou
   for (const auto& activity : route) {
     if (holds_alternative<BusActivity>(activity)) {
       auto bus_activity = get<BusActivity>(activity);
-      const auto& bus = buses_.at(bus_activity.bus);
+      const auto& bus = buses_.at(string(bus_activity.bus));
 
       if (bus_activity.span_count > 0) {
         copy_n(
@@ -371,13 +371,13 @@ void MapBuilder::BuildStopLabelsOnRoute(Svg::Document& doc, const RouteInfo::Rou
   for (const auto& activity : route) {
     if (holds_alternative<WaitActivity>(activity)) {
       auto wait_activity = get<WaitActivity>(activity);
-      stop_names.push_back(wait_activity.stop_name);
+      stop_names.emplace_back(wait_activity.stop_name);
     }
   }
 
   if (route.size() > 1) {
     auto bus_activity = get<BusActivity>(route.back());
-    auto last_stop = buses_.at(bus_activity.bus).Stop(bus_activity.start_stop_idx + bus_activity.span_count);
+    auto last_stop = buses_.at(string(bus_activity.bus)).Stop(bus_activity.start_stop_idx + bus_activity.span_count);
     stop_names.push_back(last_stop);
   }
 
@@ -0,0 +1,98 @@
+#include "min_plus_kernels.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define MIN_PLUS_KERNELS_X86
+#endif
+
+namespace Graph {
+
+namespace {
+
+using RelaxRowKernel = void (*)(double, const double*, const CompactId*, double*, CompactId*, size_t);
+
+void RelaxMinPlusRowScalar(double weight_from,
+                           const double* through_weights, const CompactId* through_prev_edges,
+                           double* weights, CompactId* prev_edges, size_t count) {
+  for (size_t j = 0; j < count; ++j) {
+    const double candidate_weight = weight_from + through_weights[j];
+    if (candidate_weight < weights[j]) {
+      weights[j] = candidate_weight;
+      prev_edges[j] = through_prev_edges[j];
+    }
+  }
+}
+
+#if defined(MIN_PLUS_KERNELS_X86) && defined(__SSE2__)
+void RelaxMinPlusRowSse2(double weight_from,
+                         const double* through_weights, const CompactId* through_prev_edges,
+                         double* weights, CompactId* prev_edges, size_t count) {
+  const __m128d from = _mm_set1_pd(weight_from);
+  size_t j = 0;
+  for (; j + 2 <= count; j += 2) {
+    const __m128d candidate = _mm_add_pd(from, _mm_loadu_pd(through_weights + j));
+    const __m128d current = _mm_loadu_pd(weights + j);
+    const __m128d mask = _mm_cmplt_pd(candidate, current);
+    _mm_storeu_pd(weights + j, _mm_or_pd(_mm_and_pd(mask, candidate), _mm_andnot_pd(mask, current)));
+
+    // Narrow the two 64-bit lane masks to the 32-bit lanes of the edge ids
+    const __m128i edge_mask = _mm_shuffle_epi32(_mm_castpd_si128(mask), _MM_SHUFFLE(2, 0, 2, 0));
+    const __m128i prev = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(prev_edges + j));
+    const __m128i through = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(through_prev_edges + j));
+    _mm_storel_epi64(reinterpret_cast<__m128i*>(prev_edges + j),
+                     _mm_or_si128(_mm_and_si128(edge_mask, through), _mm_andnot_si128(edge_mask, prev)));
+  }
+  RelaxMinPlusRowScalar(weight_from, through_weights + j, through_prev_edges + j,
+                        weights + j, prev_edges + j, count - j);
+}
+#endif
+
+#if defined(MIN_PLUS_KERNELS_X86)
+__attribute__((target("avx2")))
+void RelaxMinPlusRowAvx2(double weight_from,
+                         const double* through_weights, const CompactId* through_prev_edges,
+                         double* weights, CompactId* prev_edges, size_t count) {
+  const __m256d from = _mm256_set1_pd(weight_from);
+  const __m256i low_halves = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+  size_t j = 0;
+  for (; j + 4 <= count; j += 4) {
+    const __m256d candidate = _mm256_add_pd(from, _mm256_loadu_pd(through_weights + j));
+    const __m256d current = _mm256_loadu_pd(weights + j);
+    const __m256d mask = _mm256_cmp_pd(candidate, current, _CMP_LT_OQ);
+    _mm256_storeu_pd(weights + j, _mm256_blendv_pd(current, candidate, mask));
+
+    // Narrow the four 64-bit lane masks to the 32-bit lanes of the edge ids
+    const __m128i edge_mask = _mm256_castsi256_si128(
+        _mm256_permutevar8x32_epi32(_mm256_castpd_si256(mask), low_halves));
+    const __m128i prev = _mm_loadu_si128(reinterpret_cast<const __m128i*>(prev_edges + j));
+    const __m128i through = _mm_loadu_si128(reinterpret_cast<const __m128i*>(through_prev_edges + j));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(prev_edges + j), _mm_blendv_epi8(prev, through, edge_mask));
+  }
+  RelaxMinPlusRowScalar(weight_from, through_weights + j, through_prev_edges + j,
+                        weights + j, prev_edges + j, count - j);
+}
+#endif
+
+RelaxRowKernel SelectRelaxRowKernel() {
+#if defined(MIN_PLUS_KERNELS_X86)
+  if (__builtin_cpu_supports("avx2")) {
+    return RelaxMinPlusRowAvx2;
+  }
+#endif
+#if defined(MIN_PLUS_KERNELS_X86) && defined(__SSE2__)
+  return RelaxMinPlusRowSse2;
+#endif
+  return RelaxMinPlusRowScalar;
+}
+
+const RelaxRowKernel relax_row_kernel = SelectRelaxRowKernel();
+
+}
+
+void RelaxMinPlusRow(double weight_from,
+                     const double* through_weights, const CompactId* through_prev_edges,
+                     double* weights, CompactId* prev_edges, size_t count) {
+  relax_row_kernel(weight_from, through_weights, through_prev_edges, weights, prev_edges, count);
+}
+
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include "graph.h"
+
+#include <cstddef>
+
+namespace Graph {
+
+  // Min-plus update of one table row through an intermediate vertex:
+  // weights[j] = min(weights[j], weight_from + through_weights[j]), and
+  // prev_edges[j] takes through_prev_edges[j] wherever the weight improved.
+  // Uses AVX2 or SSE2 when the CPU has them and a scalar loop otherwise.
+  void RelaxMinPlusRow(double weight_from,
+                       const double* through_weights, const CompactId* through_prev_edges,
+                       double* weights, CompactId* prev_edges, size_t count);
+
+}
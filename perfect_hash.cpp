@@ -0,0 +1,136 @@
+#include "perfect_hash.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+
+using namespace std;
+
+namespace PerfectHash {
+
+namespace {
+
+constexpr size_t NAMES_PER_BUCKET = 4;
+// Slots per name: with every slot taken the last buckets would need seeds in
+// proportion to the number of names to find the few free ones
+constexpr double SLOTS_PER_NAME = 1.25;
+// A table whose buckets cannot all be placed with seeds below this is
+// dropped for a larger one
+constexpr uint32_t MAX_SEED = 1 << 16;
+
+uint64_t Mix(uint64_t value) {
+  value = (value ^ (value >> 30)) * 0xbf58476d1ce4e5b9ull;
+  value = (value ^ (value >> 27)) * 0x94d049bb133111ebull;
+  return value ^ (value >> 31);
+}
+
+uint64_t Hash(string_view name) {
+  uint64_t hash = 14695981039346656037ull;
+  for (const char c : name) {
+    hash = (hash ^ static_cast<unsigned char>(c)) * 1099511628211ull;
+  }
+  return Mix(hash);
+}
+
+size_t Slot(uint64_t hash, uint32_t seed, size_t slot_count) {
+  return Mix(hash + seed * 0x9e3779b97f4a7c15ull) % slot_count;
+}
+
+// Equal hashes fall into the same bucket
+bool HasEqualHashes(const vector<uint64_t>& hashes, const vector<vector<size_t>>& buckets) {
+  for (const auto& bucket : buckets) {
+    for (size_t i = 0; i < bucket.size(); ++i) {
+      for (size_t j = 0; j < i; ++j) {
+        if (hashes[bucket[i]] == hashes[bucket[j]]) {
+          return true;
+        }
+      }
+    }
+  }
+  return false;
+}
+
+// Places the buckets largest first into slot_count slots, nullopt if some
+// bucket finds no seed
+optional<TransportGuide::NameIndex> Place(const vector<uint64_t>& hashes, const vector<vector<size_t>>& buckets,
+                                          const vector<size_t>& order, size_t slot_count) {
+  TransportGuide::NameIndex index;
+  index.mutable_bucket_seeds()->Resize(buckets.size(), 0);
+  index.mutable_slot_ids()->Resize(slot_count, 0);
+  vector<bool> taken(slot_count, false);
+  vector<size_t> slots;
+  for (const size_t bucket : order) {
+    if (buckets[bucket].empty()) {
+      break;
+    }
+    for (uint32_t seed = 0; ; ++seed) {
+      if (seed == MAX_SEED) {
+        return nullopt;
+      }
+      slots.clear();
+      for (const size_t id : buckets[bucket]) {
+        const size_t slot = Slot(hashes[id], seed, slot_count);
+        if (taken[slot] || find(begin(slots), end(slots), slot) != end(slots)) {
+          break;
+        }
+        slots.push_back(slot);
+      }
+      if (slots.size() == buckets[bucket].size()) {
+        for (size_t i = 0; i < slots.size(); ++i) {
+          taken[slots[i]] = true;
+          index.set_slot_ids(slots[i], buckets[bucket][i]);
+        }
+        index.set_bucket_seeds(bucket, seed);
+        break;
+      }
+    }
+  }
+  return index;
+}
+
+}
+
+TransportGuide::NameIndex Build(const vector<string_view>& names) {
+  if (names.empty()) {
+    return {};
+  }
+
+  const size_t bucket_count = names.size() / NAMES_PER_BUCKET + 1;
+  vector<uint64_t> hashes;
+  hashes.reserve(names.size());
+  vector<vector<size_t>> buckets(bucket_count);
+  for (size_t id = 0; id < names.size(); ++id) {
+    hashes.push_back(Hash(names[id]));
+    buckets[hashes.back() % bucket_count].push_back(id);
+  }
+
+  vector<size_t> order(bucket_count);
+  iota(begin(order), end(order), 0);
+  stable_sort(begin(order), end(order), [&buckets](size_t lhs, size_t rhs) {
+    return buckets[lhs].size() > buckets[rhs].size();
+  });
+
+  // Names of equal hashes share every slot, so no table would fit them
+  if (HasEqualHashes(hashes, buckets)) {
+    throw invalid_argument("cannot build a perfect hash of names with equal hashes");
+  }
+
+  for (size_t slot_count = static_cast<size_t>(names.size() * SLOTS_PER_NAME) + 1; ; slot_count += slot_count / 4 + 1) {
+    if (auto index = Place(hashes, buckets, order, slot_count)) {
+      return move(*index);
+    }
+  }
+}
+
+optional<size_t> Find(const TransportGuide::NameIndex& index, string_view name) {
+  if (index.slot_ids().empty()) {
+    return nullopt;
+  }
+  const uint64_t hash = Hash(name);
+  const uint32_t seed = index.bucket_seeds(hash % index.bucket_seeds_size());
+  return index.slot_ids(Slot(hash, seed, index.slot_ids_size()));
+}
+
+}
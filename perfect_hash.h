@@ -0,0 +1,25 @@
+#pragma once
+
+#include "transport_catalog.pb.h"
+
+#include <cstddef>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+// Perfect hash over a fixed set of names, built by hash and displace: the
+// hash of a name picks a bucket, and every bucket stores the seed that
+// rehashes all of its names to distinct free slots. Buckets are placed
+// largest first, trying seeds in order, into a table a quarter larger than
+// the set, which keeps seeds small; a table that still fails is dropped for
+// a larger one. Looking a name up costs one hash of it; a name outside the
+// set lands on an arbitrary slot, so callers compare it with the name at the
+// returned index.
+namespace PerfectHash {
+
+  TransportGuide::NameIndex Build(const std::vector<std::string_view>& names);
+
+  // Index of the only name of the set that may equal name
+  std::optional<size_t> Find(const TransportGuide::NameIndex& index, std::string_view name);
+
+}
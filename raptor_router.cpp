@@ -0,0 +1,114 @@
+#include "raptor_router.h"
+
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+using namespace std;
+
+RaptorRouter::RaptorRouter(size_t stop_count, vector<BusLine> buses, double wait_time)
+  : stop_count_(stop_count)
+  , buses_(move(buses))
+  , wait_time_(wait_time)
+  , stop_buses_(stop_count)
+{
+  for (size_t bus = 0; bus < buses_.size(); ++bus) {
+    const auto& stops = buses_[bus].stops;
+    for (size_t idx = 0; idx < stops.size(); ++idx) {
+      auto& stop_buses = stop_buses_[stops[idx]];
+      if (stop_buses.empty() || stop_buses.back().first != bus) {
+        stop_buses.emplace_back(bus, idx);
+      }
+    }
+  }
+}
+
+size_t RaptorRouter::LabelBefore(const vector<Label>& labels, size_t label, size_t round) {
+  while (label != NO_LABEL && labels[label].round >= round) {
+    label = labels[label].replaced;
+  }
+  return label;
+}
+
+void RaptorRouter::ScanBus(size_t bus, size_t first_idx, size_t target, size_t round,
+                           vector<Label>& labels, vector<size_t>& best, vector<size_t>& marked) const {
+  const auto& line = buses_[bus];
+  optional<size_t> board_idx;
+  double board_time = 0;
+  double ride_time = 0;
+
+  for (size_t idx = first_idx; idx < line.stops.size(); ++idx) {
+    const size_t stop = line.stops[idx];
+
+    if (board_idx) {
+      ride_time += line.ride_times[idx - 1];
+      const double arrival_time = board_time + ride_time;
+      const size_t label = best[stop];
+      const size_t target_label = best[target];
+      if ((label == NO_LABEL || arrival_time < labels[label].time)
+          && (target_label == NO_LABEL || arrival_time < labels[target_label].time)) {
+        const Ride ride{bus, *board_idx, idx, ride_time};
+        if (label != NO_LABEL && labels[label].round == round) {
+          labels[label].time = arrival_time;
+          labels[label].ride = ride;
+        } else {
+          best[stop] = labels.size();
+          labels.push_back(Label{arrival_time, ride, round, label});
+          marked.push_back(stop);
+        }
+      }
+    }
+
+    const size_t board_label = LabelBefore(labels, best[stop], round);
+    if (idx + 1 < line.stops.size() && board_label != NO_LABEL
+        && (!board_idx || labels[board_label].time + wait_time_ < board_time + ride_time)) {
+      board_idx = idx;
+      board_time = labels[board_label].time + wait_time_;
+      ride_time = 0;
+    }
+  }
+}
+
+optional<RaptorRouter::Journey> RaptorRouter::FindJourney(size_t from, size_t to) const {
+  vector<Label> labels{Label{0, nullopt, 0, NO_LABEL}};
+  vector<size_t> best(stop_count_, NO_LABEL);
+  best[from] = 0;
+  vector<size_t> marked{from};
+
+  constexpr size_t NOT_SCANNED = numeric_limits<size_t>::max();
+  vector<size_t> first_idx(buses_.size(), NOT_SCANNED);
+  vector<size_t> scanned_buses;
+
+  for (size_t round = 1; !marked.empty(); ++round) {
+    // Buses are scanned in the order of their stops, which settles ties
+    sort(begin(marked), end(marked));
+    scanned_buses.clear();
+    for (const size_t stop : marked) {
+      for (const auto& [bus, idx] : stop_buses_[stop]) {
+        if (first_idx[bus] == NOT_SCANNED) {
+          scanned_buses.push_back(bus);
+        }
+        first_idx[bus] = min(first_idx[bus], idx);
+      }
+    }
+    marked.clear();
+
+    for (const size_t bus : scanned_buses) {
+      ScanBus(bus, first_idx[bus], to, round, labels, best, marked);
+      first_idx[bus] = NOT_SCANNED;
+    }
+  }
+
+  if (best[to] == NO_LABEL) {
+    return nullopt;
+  }
+
+  Journey journey{labels[best[to]].time, {}};
+  for (size_t label = best[to]; labels[label].ride; ) {
+    const Ride& ride = *labels[label].ride;
+    journey.rides.push_back(ride);
+    label = LabelBefore(labels, best[buses_[ride.bus].stops[ride.board_idx]], labels[label].round);
+  }
+  reverse(begin(journey.rides), end(journey.rides));
+  return journey;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// Round-based router over bus stop sequences, no graph is built. Round k
+// finds the best times reachable with exactly k more rides than round k - 1:
+// every bus serving a stop improved in the previous round is scanned once,
+// boarding where the previous round's label plus the wait is cheapest.
+class RaptorRouter {
+public:
+  struct BusLine {
+    std::vector<size_t> stops;
+    std::vector<double> ride_times; // ride_times[i] goes from stops[i] to stops[i + 1]
+  };
+
+  struct Ride {
+    size_t bus;
+    size_t board_idx;
+    size_t alight_idx;
+    double time;
+  };
+
+  struct Journey {
+    double total_time;
+    std::vector<Ride> rides;
+  };
+
+  RaptorRouter(size_t stop_count, std::vector<BusLine> buses, double wait_time);
+
+  std::optional<Journey> FindJourney(size_t from, size_t to) const;
+
+private:
+  static constexpr size_t NO_LABEL = static_cast<size_t>(-1);
+
+  // Labels are only added for stops improved in a round; each keeps the
+  // label it replaced, so the labels of earlier rounds stay reachable
+  struct Label {
+    double time;
+    std::optional<Ride> ride;
+    size_t round;
+    size_t replaced;
+  };
+
+  size_t stop_count_;
+  std::vector<BusLine> buses_;
+  double wait_time_;
+  // For every stop, the buses serving it with the first position of the stop
+  std::vector<std::vector<std::pair<size_t, size_t>>> stop_buses_;
+
+  // The label a stop had before the round, following label back
+  static size_t LabelBefore(const std::vector<Label>& labels, size_t label, size_t round);
+
+  void ScanBus(size_t bus, size_t first_idx, size_t target, size_t round,
+               std::vector<Label>& labels, std::vector<size_t>& best, std::vector<size_t>& marked) const;
+};
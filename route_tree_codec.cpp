@@ -0,0 +1,228 @@
+#include "route_tree_codec.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <string>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define ROUTE_TREE_CODEC_X86
+#endif
+
+using namespace std;
+
+namespace RouteTreeCodec {
+
+namespace {
+
+// Decoding may read this far past the last data byte of a group
+constexpr size_t GROUP_OVERREAD = 16;
+
+uint32_t ZigZag(uint32_t delta) {
+  return (delta << 1) ^ static_cast<uint32_t>(-static_cast<int32_t>(delta >> 31));
+}
+
+uint32_t UnZigZag(uint32_t value) {
+  return (value >> 1) ^ -(value & 1);
+}
+
+uint64_t ZigZag64(int64_t delta) {
+  return (static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63);
+}
+
+int64_t UnZigZag64(uint64_t value) {
+  return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+size_t ByteLength(uint32_t value) {
+  return value < (1u << 8) ? 1 : value < (1u << 16) ? 2 : value < (1u << 24) ? 3 : 4;
+}
+
+size_t BlockCount(size_t value_count) {
+  return (value_count + BLOCK_SIZE - 1) / BLOCK_SIZE;
+}
+
+size_t BlockLength(size_t value_count, size_t block) {
+  return min(BLOCK_SIZE, value_count - block * BLOCK_SIZE);
+}
+
+struct GroupTables {
+  array<array<uint8_t, 16>, 256> shuffles;
+  array<uint8_t, 256> lengths;
+};
+
+// For every control byte: the shuffle spreading the group's bytes over four
+// 32-bit lanes (0x80 clears a byte) and the total length of the group
+GroupTables BuildGroupTables() {
+  GroupTables tables;
+  for (size_t control = 0; control < 256; ++control) {
+    uint8_t source = 0;
+    for (size_t lane = 0; lane < 4; ++lane) {
+      const size_t length = ((control >> (2 * lane)) & 3) + 1;
+      for (size_t byte = 0; byte < 4; ++byte) {
+        tables.shuffles[control][4 * lane + byte] = byte < length ? source++ : 0x80;
+      }
+    }
+    tables.lengths[control] = source;
+  }
+  return tables;
+}
+
+const GroupTables group_tables = BuildGroupTables();
+
+using DecodeGroupsKernel = const uint8_t* (*)(const uint8_t* control, const uint8_t* data, size_t group_count, uint32_t* out);
+
+const uint8_t* DecodeGroupsScalar(const uint8_t* control, const uint8_t* data, size_t group_count, uint32_t* out) {
+  for (size_t group = 0; group < group_count; ++group) {
+    for (size_t lane = 0; lane < 4; ++lane) {
+      const size_t length = ((control[group] >> (2 * lane)) & 3) + 1;
+      uint32_t value = 0;
+      for (size_t byte = 0; byte < length; ++byte) {
+        value |= static_cast<uint32_t>(data[byte]) << (8 * byte);
+      }
+      *out++ = value;
+      data += length;
+    }
+  }
+  return data;
+}
+
+#if defined(ROUTE_TREE_CODEC_X86)
+__attribute__((target("ssse3")))
+const uint8_t* DecodeGroupsSsse3(const uint8_t* control, const uint8_t* data, size_t group_count, uint32_t* out) {
+  for (size_t group = 0; group < group_count; ++group) {
+    const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+    const __m128i shuffle = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group_tables.shuffles[control[group]].data()));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4 * group), _mm_shuffle_epi8(bytes, shuffle));
+    data += group_tables.lengths[control[group]];
+  }
+  return data;
+}
+#endif
+
+DecodeGroupsKernel SelectDecodeGroupsKernel() {
+#if defined(ROUTE_TREE_CODEC_X86)
+  if (__builtin_cpu_supports("ssse3")) {
+    return DecodeGroupsSsse3;
+  }
+#endif
+  return DecodeGroupsScalar;
+}
+
+const DecodeGroupsKernel decode_groups_kernel = SelectDecodeGroupsKernel();
+
+// Decodes block values rounded up to a whole group into out
+void DecodePrevEdgeBlock(const TransportGuide::RouteTree& tree, size_t block, uint32_t* out) {
+  const size_t length = BlockLength(tree.vertex_count(), block);
+  const size_t group_count = (length + 3) / 4;
+  const auto* control = reinterpret_cast<const uint8_t*>(tree.prev_edges().data()) + tree.prev_edge_blocks(block);
+  decode_groups_kernel(control, control + group_count, group_count, out);
+
+  for (size_t i = 0; i < length; ++i) {
+    out[i] = UnZigZag(out[i]) + (i >= 2 ? out[i - 2] : 0);
+  }
+}
+
+void AppendVarint(string& data, uint64_t value) {
+  while (value >= 0x80) {
+    data.push_back(static_cast<char>(value | 0x80));
+    value >>= 7;
+  }
+  data.push_back(static_cast<char>(value));
+}
+
+uint64_t ReadVarint(const uint8_t*& data) {
+  uint64_t value = 0;
+  for (size_t shift = 0; ; shift += 7) {
+    const uint8_t byte = *data++;
+    value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) {
+      return value;
+    }
+  }
+}
+
+}
+
+TransportGuide::RouteTree Encode(const vector<uint32_t>& prev_edges, const vector<double>& weights) {
+  TransportGuide::RouteTree tree;
+  tree.set_vertex_count(prev_edges.size());
+  tree.set_stop_count(weights.size());
+
+  string& edge_data = *tree.mutable_prev_edges();
+  for (size_t block = 0; block < BlockCount(prev_edges.size()); ++block) {
+    const size_t begin = block * BLOCK_SIZE;
+    const size_t length = BlockLength(prev_edges.size(), block);
+    string control((length + 3) / 4, '\0');
+    string data;
+    for (size_t i = 0; i < (length + 3) / 4 * 4; ++i) {
+      const uint32_t value = i < length
+          ? ZigZag(prev_edges[begin + i] - (i >= 2 ? prev_edges[begin + i - 2] : 0))
+          : 0;
+      const size_t value_length = ByteLength(value);
+      control[i / 4] |= static_cast<char>((value_length - 1) << (2 * (i % 4)));
+      for (size_t byte = 0; byte < value_length; ++byte) {
+        data.push_back(static_cast<char>(value >> (8 * byte)));
+      }
+    }
+    tree.add_prev_edge_blocks(edge_data.size());
+    edge_data += control;
+    edge_data += data;
+  }
+  edge_data.append(GROUP_OVERREAD, '\0');
+
+  string& weight_data = *tree.mutable_weights();
+  for (size_t block = 0; block < BlockCount(weights.size()); ++block) {
+    tree.add_weight_blocks(weight_data.size());
+    int64_t previous = 0;
+    for (size_t i = block * BLOCK_SIZE; i < block * BLOCK_SIZE + BlockLength(weights.size(), block); ++i) {
+      const int64_t quantized = llround(weights[i] / WEIGHT_QUANTUM);
+      AppendVarint(weight_data, ZigZag64(quantized - previous));
+      previous = quantized;
+    }
+  }
+
+  return tree;
+}
+
+uint32_t GetPrevEdge(const TransportGuide::RouteTree& tree, size_t vertex) {
+  uint32_t values[BLOCK_SIZE];
+  DecodePrevEdgeBlock(tree, vertex / BLOCK_SIZE, values);
+  return values[vertex % BLOCK_SIZE];
+}
+
+double GetWeight(const TransportGuide::RouteTree& tree, size_t stop) {
+  const auto* data = reinterpret_cast<const uint8_t*>(tree.weights().data()) + tree.weight_blocks(stop / BLOCK_SIZE);
+  int64_t quantized = 0;
+  for (size_t i = 0; i <= stop % BLOCK_SIZE; ++i) {
+    quantized += UnZigZag64(ReadVarint(data));
+  }
+  return quantized * WEIGHT_QUANTUM;
+}
+
+vector<uint32_t> DecodePrevEdges(const TransportGuide::RouteTree& tree) {
+  vector<uint32_t> prev_edges(BlockCount(tree.vertex_count()) * BLOCK_SIZE);
+  for (size_t block = 0; block < BlockCount(tree.vertex_count()); ++block) {
+    DecodePrevEdgeBlock(tree, block, prev_edges.data() + block * BLOCK_SIZE);
+  }
+  prev_edges.resize(tree.vertex_count());
+  return prev_edges;
+}
+
+vector<double> DecodeWeights(const TransportGuide::RouteTree& tree) {
+  vector<double> weights;
+  weights.reserve(tree.stop_count());
+  for (size_t block = 0; block < BlockCount(tree.stop_count()); ++block) {
+    const auto* data = reinterpret_cast<const uint8_t*>(tree.weights().data()) + tree.weight_blocks(block);
+    int64_t quantized = 0;
+    for (size_t i = 0; i < BlockLength(tree.stop_count(), block); ++i) {
+      quantized += UnZigZag64(ReadVarint(data));
+      weights.push_back(quantized * WEIGHT_QUANTUM);
+    }
+  }
+  return weights;
+}
+
+}
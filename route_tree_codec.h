@@ -0,0 +1,35 @@
+#pragma once
+
+#include "router.pb.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Compressed form of the route trees stored in the base. Values are split
+// into blocks of BLOCK_SIZE with the byte offset of every block recorded, so
+// one value is found by decoding one block.
+//
+// Parent edges (edge id plus one, 0 for none) are delta coded against the
+// vertex two positions back, as the two vertices of a stop alternate between
+// bus and wait edges, zigzag mapped and packed in Stream VByte form: a control
+// byte with the byte lengths of four values, then their bytes. Groups of four
+// are decoded with one byte shuffle when the CPU has SSSE3.
+//
+// Route weights are quantized to WEIGHT_QUANTUM, exact for the six decimals
+// responses print, and stored as zigzag varints of the difference to the
+// previous stop.
+namespace RouteTreeCodec {
+
+  constexpr size_t BLOCK_SIZE = 128;
+  constexpr double WEIGHT_QUANTUM = 1e-6;
+
+  TransportGuide::RouteTree Encode(const std::vector<uint32_t>& prev_edges, const std::vector<double>& weights);
+
+  uint32_t GetPrevEdge(const TransportGuide::RouteTree& tree, size_t vertex);
+  double GetWeight(const TransportGuide::RouteTree& tree, size_t stop);
+
+  std::vector<uint32_t> DecodePrevEdges(const TransportGuide::RouteTree& tree);
+  std::vector<double> DecodeWeights(const TransportGuide::RouteTree& tree);
+
+}
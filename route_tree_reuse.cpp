@@ -0,0 +1,184 @@
+#include "route_tree_reuse.h"
+
+#include "route_tree_codec.h"
+
+#include <algorithm>
+#include <limits>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+
+using namespace std;
+
+namespace {
+
+uint64_t EndsKey(uint32_t from, uint32_t to) {
+  return static_cast<uint64_t>(from) << 32 | to;
+}
+
+}
+
+unique_ptr<RouteTreeReuse> RouteTreeReuse::Open(const string& file_name, const RoutingSettings& routing_settings,
+                                                const map<string, size_t>& stop_idx,
+                                                const Graph::DirectedWeightedGraph<double>& graph,
+                                                const vector<EdgeActivity>& edge_description,
+                                                const vector<string_view>& bus_names) {
+  if (routing_settings.routing_mode != RoutingMode::ALL_PAIRS || routing_settings.graph_model != GraphModel::STOP_PAIRS) {
+    return nullptr;
+  }
+
+  TransportGuide::TransportCatalog catalog;
+  auto trees = LazyRouteTrees::Open(file_name, 1, catalog);
+  if (!trees) {
+    return nullptr;
+  }
+
+  // Bases of other modes, of the route stops graph or written before edge
+  // ends were stored cannot be matched
+  const auto& router = catalog.router();
+  const size_t previous_vertex_count = 2 * catalog.stops_size();
+  const size_t edge_count = router.edge_from_size();
+  const auto outside = [previous_vertex_count](uint32_t vertex) { return vertex >= previous_vertex_count; };
+  if (static_cast<RoutingMode>(router.settings().routing_mode()) != RoutingMode::ALL_PAIRS
+      || router.settings().bus_wait_time() != routing_settings.bus_wait_time
+      || router.settings().bus_velocity() != routing_settings.bus_velocity
+      || static_cast<size_t>(router.edge_to_size()) != edge_count
+      || static_cast<size_t>(router.wait_activity_size() + router.bus_activity_size()) != edge_count
+      || any_of(begin(router.edge_from()), end(router.edge_from()), outside)
+      || any_of(begin(router.edge_to()), end(router.edge_to()), outside)) {
+    return nullptr;
+  }
+
+  const size_t vertex_count = graph.GetVertexCount();
+  unique_ptr<RouteTreeReuse> reuse(new RouteTreeReuse(
+      move(trees), routing_settings.bus_wait_time, vertex_count / 2, vertex_count));
+
+  reuse->vertex_.assign(previous_vertex_count, NO_VERTEX);
+  reuse->previous_vertex_.assign(vertex_count, NO_VERTEX);
+  for (int stop = 0; stop < catalog.stops_size(); ++stop) {
+    const auto it = stop_idx.find(catalog.stops(stop).name());
+    if (it == stop_idx.end()) {
+      continue;
+    }
+    for (uint32_t wait = 0; wait < 2; ++wait) {
+      reuse->vertex_[2 * stop + wait] = 2 * it->second + wait;
+      reuse->previous_vertex_[2 * it->second + wait] = 2 * stop + wait;
+    }
+  }
+
+  // Wait edges and bus edges never share both ends, so an empty label marks
+  // a wait
+  const auto label = [&edge_description, &bus_names](Graph::EdgeId edge_id) -> string_view {
+    const auto& activity = edge_description[edge_id];
+    return activity.kind == EdgeActivity::Kind::BUS ? bus_names[activity.id] : string_view{};
+  };
+  unordered_map<uint64_t, vector<Graph::EdgeId>> edges_by_ends;
+  for (Graph::EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+    const auto edge = graph.GetEdge(edge_id);
+    edges_by_ends[EndsKey(edge.from, edge.to)].push_back(edge_id);
+  }
+
+  vector<bool> matched(graph.GetEdgeCount(), false);
+  reuse->edge_.assign(edge_count, 0);
+  for (size_t edge_id = 0; edge_id < edge_count; ++edge_id) {
+    const uint32_t from = reuse->vertex_[router.edge_from(edge_id)];
+    const uint32_t to = reuse->vertex_[router.edge_to(edge_id)];
+    if (from == NO_VERTEX || to == NO_VERTEX) {
+      continue;
+    }
+    const auto it = edges_by_ends.find(EndsKey(from, to));
+    if (it == edges_by_ends.end()) {
+      continue;
+    }
+
+    string_view previous_label;
+    double weight = router.settings().bus_wait_time();
+    if (edge_id >= static_cast<size_t>(router.wait_activity_size())) {
+      const auto& bus = router.bus_activity(edge_id - router.wait_activity_size());
+      previous_label = catalog.buses(bus.bus_id()).name();
+      weight = bus.time();
+    }
+    for (const auto new_edge_id : it->second) {
+      if (!matched[new_edge_id] && graph.GetEdge(new_edge_id).weight == weight && label(new_edge_id) == previous_label) {
+        matched[new_edge_id] = true;
+        reuse->edge_[edge_id] = new_edge_id + 1;
+        break;
+      }
+    }
+  }
+
+  // New edges leaving new stops can only be reached through other new edges
+  for (Graph::EdgeId edge_id = 0; edge_id < graph.GetEdgeCount(); ++edge_id) {
+    const auto edge = graph.GetEdge(edge_id);
+    if (!matched[edge_id] && reuse->previous_vertex_[edge.from] != NO_VERTEX) {
+      reuse->added_edges_.push_back({reuse->previous_vertex_[edge.from], reuse->previous_vertex_[edge.to], edge.weight});
+    }
+  }
+
+  return reuse;
+}
+
+RouteTreeReuse::RouteTreeReuse(unique_ptr<LazyRouteTrees> trees, double wait_time, size_t stop_count, size_t vertex_count)
+  : trees_(move(trees))
+  , wait_time_(wait_time)
+  , stop_count_(stop_count)
+  , vertex_count_(vertex_count)
+{
+}
+
+optional<TransportGuide::RouteTree> RouteTreeReuse::ReadTree(size_t stop_id) {
+  const uint32_t previous_vertex = previous_vertex_[2 * stop_id];
+  if (previous_vertex == NO_VERTEX) {
+    return nullopt;
+  }
+  lock_guard lock(read_mutex_);
+  return trees_->Read(previous_vertex / 2);
+}
+
+optional<TransportGuide::RouteTree> RouteTreeReuse::Reuse(size_t stop_id, const TransportGuide::RouteTree& previous) const {
+  const auto prev_edges = RouteTreeCodec::DecodePrevEdges(previous);
+  const auto weights = RouteTreeCodec::DecodeWeights(previous);
+  if (prev_edges.size() != vertex_.size() || 2 * weights.size() != vertex_.size()) {
+    return nullopt;
+  }
+
+  // Stored weights are quantized, so an added edge that comes within a
+  // quantum of a distance may tie with it or improve on it; either could
+  // change the tree a full rebuild picks, so the tree is rebuilt
+  const uint32_t source = previous_vertex_[2 * stop_id];
+  const auto distance = [&](uint32_t vertex) {
+    const uint32_t arrival = vertex & ~1u;
+    if (!prev_edges[arrival] && arrival != source) {
+      return numeric_limits<double>::infinity();
+    }
+    return weights[vertex / 2] + (vertex % 2 ? wait_time_ : 0);
+  };
+  for (const auto& edge : added_edges_) {
+    const double from_distance = distance(edge.from);
+    if (from_distance == numeric_limits<double>::infinity()) {
+      continue;
+    }
+    if (edge.to == NO_VERTEX || from_distance + edge.weight < distance(edge.to) + RouteTreeCodec::WEIGHT_QUANTUM) {
+      return nullopt;
+    }
+  }
+
+  vector<uint32_t> new_prev_edges(vertex_count_, 0);
+  for (size_t vertex = 0; vertex < prev_edges.size(); ++vertex) {
+    if (vertex_[vertex] == NO_VERTEX || !prev_edges[vertex]) {
+      continue;
+    }
+    if (!edge_[prev_edges[vertex] - 1]) {
+      return nullopt;
+    }
+    new_prev_edges[vertex_[vertex]] = edge_[prev_edges[vertex] - 1];
+  }
+  vector<double> new_weights(stop_count_, 0);
+  for (size_t stop = 0; stop < weights.size(); ++stop) {
+    if (vertex_[2 * stop] != NO_VERTEX) {
+      new_weights[vertex_[2 * stop] / 2] = weights[stop];
+    }
+  }
+
+  return RouteTreeCodec::Encode(new_prev_edges, new_weights);
+}
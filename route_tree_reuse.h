@@ -0,0 +1,62 @@
+#pragma once
+
+#include "graph.h"
+#include "lazy_route_trees.h"
+#include "router.pb.h"
+#include "transport_catalog.pb.h"
+#include "transport_manager_command.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Route trees of a base built from an earlier input, carried over into the
+// base being built. Stops are matched by name and edges by their end stops,
+// bus and weight. The tree of a source stop is kept if all of its edges are
+// still in the graph and, under its distances d, no unmatched new edge
+// (u, v, w) has d(u) + w < d(v): then its routes are still shortest ones.
+// Only all-pairs bases over the stop pairs graph are reused.
+class RouteTreeReuse {
+public:
+  // Returns nullptr if the previous base has no trees to reuse for a graph
+  // built with these settings
+  static std::unique_ptr<RouteTreeReuse> Open(const std::string& file_name, const RoutingSettings& routing_settings,
+                                              const std::map<std::string, size_t>& stop_idx,
+                                              const Graph::DirectedWeightedGraph<double>& graph,
+                                              const std::vector<EdgeActivity>& edge_description,
+                                              const std::vector<std::string_view>& bus_names);
+
+  // Previous tree of the stop, if the stop was there. Reads from the file;
+  // calls from several threads take turns.
+  std::optional<TransportGuide::RouteTree> ReadTree(size_t stop_id);
+  // The previous tree of the stop in terms of the new graph, nullopt if its
+  // routes may have changed
+  std::optional<TransportGuide::RouteTree> Reuse(size_t stop_id, const TransportGuide::RouteTree& previous) const;
+
+private:
+  static constexpr uint32_t NO_VERTEX = UINT32_MAX;
+
+  struct AddedEdge {
+    uint32_t from; // previous vertex
+    uint32_t to;   // previous vertex or NO_VERTEX
+    double weight;
+  };
+
+  std::unique_ptr<LazyRouteTrees> trees_;
+  std::mutex read_mutex_;
+  double wait_time_;
+  size_t stop_count_;
+  size_t vertex_count_;
+  std::vector<uint32_t> previous_vertex_; // by new vertex
+  std::vector<uint32_t> vertex_;          // new vertex by previous one
+  std::vector<uint32_t> edge_;            // new edge plus one by previous edge, 0 if removed
+  std::vector<AddedEdge> added_edges_;
+
+  RouteTreeReuse(std::unique_ptr<LazyRouteTrees> trees, double wait_time, size_t stop_count, size_t vertex_count);
+};
@@ -0,0 +1,48 @@
+#include "route_tree_spill.h"
+
+#include <google/protobuf/io/zero_copy_stream_impl.h>
+#include <google/protobuf/util/delimited_message_util.h>
+
+#include <cstdio>
+#include <stdexcept>
+#include <utility>
+
+using namespace std;
+using namespace google::protobuf;
+
+RouteTreeSpill::RouteTreeSpill(string file_name)
+  : file_name_(move(file_name))
+  , out_(file_name_, ios::binary | ios::trunc)
+{
+  if (!out_) {
+    throw runtime_error("cannot create spill file " + file_name_);
+  }
+}
+
+RouteTreeSpill::~RouteTreeSpill() {
+  out_.close();
+  remove(file_name_.c_str());
+}
+
+void RouteTreeSpill::Append(const TransportGuide::RouteTree& tree) {
+  if (!util::SerializeDelimitedToOstream(tree, &out_)) {
+    throw runtime_error("cannot write spill file " + file_name_);
+  }
+  tree_sizes_.push_back(tree.ByteSizeLong());
+}
+
+void RouteTreeSpill::ForEach(const Visitor& visitor) {
+  out_.flush();
+  ifstream in_file(file_name_, ios::binary);
+  io::IstreamInputStream input(&in_file);
+
+  TransportGuide::RouteTree tree;
+  for (size_t i = 0; i < tree_sizes_.size(); ++i) {
+    bool clean_eof = false;
+    tree.Clear();
+    if (!util::ParseDelimitedFromZeroCopyStream(&tree, &input, &clean_eof)) {
+      throw runtime_error("cannot read spill file " + file_name_);
+    }
+    visitor(tree);
+  }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "router.pb.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Calls its argument for the route tree of every stop in order
+using RouteTreeSource = std::function<void(const std::function<void(const TransportGuide::RouteTree&)>&)>;
+
+// Route trees spilled to a temporary file as length-delimited records, so
+// make_base keeps only one batch of them in memory. The records are read
+// back in the order they were appended; the file is removed on destruction.
+class RouteTreeSpill {
+public:
+  using Visitor = std::function<void(const TransportGuide::RouteTree&)>;
+
+  explicit RouteTreeSpill(std::string file_name);
+  RouteTreeSpill(const RouteTreeSpill&) = delete;
+  RouteTreeSpill& operator=(const RouteTreeSpill&) = delete;
+  ~RouteTreeSpill();
+
+  void Append(const TransportGuide::RouteTree& tree);
+  size_t Count() const { return tree_sizes_.size(); }
+  // Serialized size of every tree
+  const std::vector<uint32_t>& TreeSizes() const { return tree_sizes_; }
+  void ForEach(const Visitor& visitor);
+
+private:
+  std::string file_name_;
+  std::ofstream out_;
+  std::vector<uint32_t> tree_sizes_;
+};
@@ -1,88 +1,112 @@
 #pragma once
 
 #include "graph.h"
+#include "router_interface.h"
 
-#include <algorithm>
 #include <cassert>
 #include <cstdint>
-#include <iterator>
+#include <limits>
 #include <optional>
-#include <unordered_map>
-#include <utility>
 #include <vector>
 
 namespace Graph {
 
   template <typename Weight>
-  class Router {
-  private:
-    using Graph = DirectedWeightedGraph<Weight>;
+  class FloydWarshallRouter : public Router<Weight> {
+  protected:
+    using typename Router<Weight>::Graph;
 
   public:
-    using RouteId = uint64_t;
-    using ExpandedRoute = std::vector<EdgeId>;
-
-    struct RouteInfo {
-      RouteId id;
-      Weight weight;
-      size_t edge_count;
-    };
-
-    Router(const Graph& graph);
-    Router(const Graph& graph, std::unordered_map<RouteId, ExpandedRoute> expanded_routes_cache);
+    using typename Router<Weight>::RouteTree;
+
+    FloydWarshallRouter(const Graph& graph);
+
+    RouteTree BuildRouteTree(VertexId from) const override;
+
+  protected:
+    // Fills the table with single edges only; relaxation is up to the caller
+    struct InitializeOnly {};
+    FloydWarshallRouter(const Graph& graph, InitializeOnly);
+
+    static constexpr CompactId NO_EDGE = std::numeric_limits<CompactId>::max();
+    static constexpr Weight UNREACHABLE = std::numeric_limits<Weight>::has_infinity
+        ? std::numeric_limits<Weight>::infinity()
+        : std::numeric_limits<Weight>::max();
+
+    // Row-major vertex_count x vertex_count table kept as two flat arrays:
+    // route weights (UNREACHABLE if there is no route) and the last edge of
+    // each route (NO_EDGE for empty and missing routes).
+    class RoutesInternalData {
+    public:
+      RoutesInternalData(size_t vertex_count = 0)
+        : vertex_count_(vertex_count)
+        , weights_(vertex_count * vertex_count, UNREACHABLE)
+        , prev_edges_(vertex_count * vertex_count, NO_EDGE)
+      {
+      }
 
-    std::optional<RouteInfo> BuildRoute(VertexId from, VertexId to) const;
-    EdgeId GetRouteEdge(RouteId route_id, size_t edge_idx) const;
-    void ReleaseRoute(RouteId route_id);
+      Weight* Weights(VertexId from) { return weights_.data() + from * vertex_count_; }
+      const Weight* Weights(VertexId from) const { return weights_.data() + from * vertex_count_; }
+      CompactId* PrevEdges(VertexId from) { return prev_edges_.data() + from * vertex_count_; }
+      const CompactId* PrevEdges(VertexId from) const { return prev_edges_.data() + from * vertex_count_; }
 
-  private:
-    const Graph& graph_;
+      void PrefetchRow(VertexId from) const {
+        if (from < vertex_count_) {
+          __builtin_prefetch(Weights(from));
+          __builtin_prefetch(PrevEdges(from));
+        }
+      }
 
-    struct RouteInternalData {
-      Weight weight;
-      std::optional<EdgeId> prev_edge;
+    private:
+      size_t vertex_count_;
+      std::vector<Weight> weights_;
+      std::vector<CompactId> prev_edges_;
     };
-    using RoutesInternalData = std::vector<std::vector<std::optional<RouteInternalData>>>;
-
-    mutable RouteId next_route_id_ = 0;
-    mutable std::unordered_map<RouteId, ExpandedRoute> expanded_routes_cache_;
 
     void InitializeRoutesInternalData(const Graph& graph) {
       const size_t vertex_count = graph.GetVertexCount();
       for (VertexId vertex = 0; vertex < vertex_count; ++vertex) {
-        routes_internal_data_[vertex][vertex] = RouteInternalData{0, std::nullopt};
-        for (const EdgeId edge_id : graph.GetIncidentEdges(vertex)) {
-          const auto& edge = graph.GetEdge(edge_id);
-          assert(edge.weight >= 0);
-          auto& route_internal_data = routes_internal_data_[vertex][edge.to];
-          if (!route_internal_data || route_internal_data->weight > edge.weight) {
-            route_internal_data = RouteInternalData{edge.weight, edge_id};
+        Weight* weights = routes_internal_data_.Weights(vertex);
+        CompactId* prev_edges = routes_internal_data_.PrevEdges(vertex);
+        weights[vertex] = 0;
+        const auto arcs = graph.GetIncidentArcs(vertex);
+        for (CompactId arc = arcs.begin; arc < arcs.end; ++arc) {
+          const Weight edge_weight = graph.GetArcWeight(arc);
+          assert(edge_weight >= 0);
+          const VertexId to = graph.GetArcTarget(arc);
+          if (weights[to] == UNREACHABLE || weights[to] > edge_weight) {
+            weights[to] = edge_weight;
+            prev_edges[to] = graph.GetArcEdge(arc);
           }
         }
       }
     }
 
-    void RelaxRoute(VertexId vertex_from, VertexId vertex_to,
-                    const RouteInternalData& route_from, const RouteInternalData& route_to) {
-      auto& route_relaxing = routes_internal_data_[vertex_from][vertex_to];
-      const Weight candidate_weight = route_from.weight + route_to.weight;
-      if (!route_relaxing || candidate_weight < route_relaxing->weight) {
-        route_relaxing = {
-            candidate_weight,
-            route_to.prev_edge
-                ? route_to.prev_edge
-                : route_from.prev_edge
-        };
-      }
-    }
-
     void RelaxRoutesInternalDataThroughVertex(size_t vertex_count, VertexId vertex_through) {
+      const Weight* through_weights = routes_internal_data_.Weights(vertex_through);
+      const CompactId* through_prev_edges = routes_internal_data_.PrevEdges(vertex_through);
+
       for (VertexId vertex_from = 0; vertex_from < vertex_count; ++vertex_from) {
-        if (const auto& route_from = routes_internal_data_[vertex_from][vertex_through]) {
-          for (VertexId vertex_to = 0; vertex_to < vertex_count; ++vertex_to) {
-            if (const auto& route_to = routes_internal_data_[vertex_through][vertex_to]) {
-              RelaxRoute(vertex_from, vertex_to, *route_from, *route_to);
-            }
+        routes_internal_data_.PrefetchRow(vertex_from + 1);
+        Weight* weights = routes_internal_data_.Weights(vertex_from);
+        CompactId* prev_edges = routes_internal_data_.PrevEdges(vertex_from);
+
+        const Weight weight_from = weights[vertex_through];
+        if (weight_from == UNREACHABLE) {
+          continue;
+        }
+        const CompactId prev_edge_from = prev_edges[vertex_through];
+
+        for (VertexId vertex_to = 0; vertex_to < vertex_count; ++vertex_to) {
+          if (through_weights[vertex_to] == UNREACHABLE) {
+            continue;
+          }
+          const Weight candidate_weight = weight_from + through_weights[vertex_to];
+          if (weights[vertex_to] == UNREACHABLE || candidate_weight < weights[vertex_to]) {
+            weights[vertex_to] = candidate_weight;
+            prev_edges[vertex_to] = through_prev_edges[vertex_to] != NO_EDGE
+                ? through_prev_edges[vertex_to]
+                : prev_edge_from;
           }
         }
       }
@@ -93,12 +117,9 @@ namespace Graph {
 
 
   template <typename Weight>
-  Router<Weight>::Router(const Graph& graph)
-      : graph_(graph),
-        routes_internal_data_(graph.GetVertexCount(), std::vector<std::optional<RouteInternalData>>(graph.GetVertexCount()))
+  FloydWarshallRouter<Weight>::FloydWarshallRouter(const Graph& graph)
+      : FloydWarshallRouter(graph, InitializeOnly{})
   {
-    InitializeRoutesInternalData(graph);
-
     const size_t vertex_count = graph.GetVertexCount();
     for (VertexId vertex_through = 0; vertex_through < vertex_count; ++vertex_through) {
       RelaxRoutesInternalDataThroughVertex(vertex_count, vertex_through);
@@ -106,42 +127,28 @@ namespace Graph {
   }
 
   template <typename Weight>
-  Router<Weight>::Router(const Graph& graph, std::unordered_map<RouteId, ExpandedRoute> expanded_routes_cache)
-      : graph_(graph),
-        expanded_routes_cache_(std::move(expanded_routes_cache)),
-        routes_internal_data_()
+  FloydWarshallRouter<Weight>::FloydWarshallRouter(const Graph& graph, InitializeOnly)
+      : Router<Weight>(graph),
+        routes_internal_data_(graph.GetVertexCount())
   {
+    InitializeRoutesInternalData(graph);
   }
 
   template <typename Weight>
-  std::optional<typename Router<Weight>::RouteInfo> Router<Weight>::BuildRoute(VertexId from, VertexId to) const {
-    const auto& route_internal_data = routes_internal_data_[from][to];
-    if (!route_internal_data) {
-      return std::nullopt;
-    }
-    const Weight weight = route_internal_data->weight;
-    std::vector<EdgeId> edges;
-    for (std::optional<EdgeId> edge_id = route_internal_data->prev_edge;
-         edge_id;
-         edge_id = routes_internal_data_[from][graph_.GetEdge(*edge_id).from]->prev_edge) {
-      edges.push_back(*edge_id);
+  typename FloydWarshallRouter<Weight>::RouteTree FloydWarshallRouter<Weight>::BuildRouteTree(VertexId from) const {
+    const Weight* weights = routes_internal_data_.Weights(from);
+    const CompactId* prev_edges = routes_internal_data_.PrevEdges(from);
+
+    RouteTree tree(this->graph_.GetVertexCount());
+    for (VertexId to = 0; to < tree.size(); ++to) {
+      if (weights[to] != UNREACHABLE) {
+        tree[to] = {
+          weights[to],
+          prev_edges[to] != NO_EDGE ? std::optional<EdgeId>{prev_edges[to]} : std::nullopt,
+        };
+      }
     }
-    std::reverse(std::begin(edges), std::end(edges));
-
-    const RouteId route_id = next_route_id_++;
-    const size_t route_edge_count = edges.size();
-    expanded_routes_cache_[route_id] = std::move(edges);
-    return RouteInfo{route_id, weight, route_edge_count};
-  }
-
-  template <typename Weight>
-  EdgeId Router<Weight>::GetRouteEdge(RouteId route_id, size_t edge_idx) const {
-    return expanded_routes_cache_.at(route_id)[edge_idx];
-  }
-
-  template <typename Weight>
-  void Router<Weight>::ReleaseRoute(RouteId route_id) {
-    expanded_routes_cache_.erase(route_id);
+    return tree;
   }
 
 }
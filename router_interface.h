@@ -0,0 +1,33 @@
+#pragma once
+
+#include "graph.h"
+
+#include <optional>
+#include <vector>
+
+namespace Graph {
+
+  template <typename Weight>
+  class Router {
+  protected:
+    using Graph = DirectedWeightedGraph<Weight>;
+
+  public:
+    struct RouteTreeNode {
+      Weight weight;
+      std::optional<EdgeId> prev_edge;
+    };
+    using RouteTree = std::vector<std::optional<RouteTreeNode>>;
+
+    Router(const Graph& graph) : graph_(graph) {}
+    virtual ~Router() {};
+
+    // Returns the shortest path tree rooted at `from`. Keeps no state, so
+    // trees of different sources may be built concurrently.
+    virtual RouteTree BuildRouteTree(VertexId from) const = 0;
+
+  protected:
+    const Graph& graph_;
+  };
+
+}
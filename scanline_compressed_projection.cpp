@@ -19,7 +19,7 @@ ScanlineCompressedProjector::ScanlineCompressedProjector(
   std::map<Coordinates, std::set<Coordinates>> route_neighbours_;
   for (const auto& [bus_name, bus] : buses) {
     const auto& bus_stops = bus.Stops();
-    for (int i = 1; i < bus_stops.size(); ++i) {
+    for (size_t i = 1; i < bus_stops.size(); ++i) {
       const auto& cur = points[stop_idx.at(bus_stops[i])];
       const auto& prev = points[stop_idx.at(bus_stops[i-1])];
       route_neighbours_[prev].insert(cur);
@@ -23,7 +23,7 @@ public:
   Stop(std::string name, Coordinates coordinates = {});
   Stop() = default;
   Stop(const Stop& other) = default;
-  std::string Name() const { return name_; }
+  const std::string& Name() const { return name_; }
   const Coordinates& StopCoordinates() const { return coordinates_; }
   Coordinates& StopCoordinates() { return coordinates_; }
   void SetCoordinates(Coordinates coordinates) { coordinates_ = coordinates; }
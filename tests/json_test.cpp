@@ -0,0 +1,54 @@
+#include "json.h"
+
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+using namespace std;
+
+namespace {
+
+void Check(bool condition, const string& message) {
+  if (!condition) {
+    throw runtime_error(message);
+  }
+}
+
+string PrintToString(const Json::Document& document) {
+  ostringstream output;
+  Json::Print(document, output);
+  return output.str();
+}
+
+// Names are unescaped in place on input, so printing must escape them again
+void TestEscapedNamesRoundTrip() {
+  const string text = R"({"name \"quoted\"": ["A\\B", "1\\x", "say \"hi\"", "tab\there", "bell\u0007"]})";
+  istringstream input(text);
+  const Json::Document document = Json::Load(input);
+
+  const auto& names = document.GetRoot().AsMap().at("name \"quoted\"").AsArray();
+  Check(names.at(0).AsString() == "A\\B", "backslash is not unescaped");
+  Check(names.at(2).AsString() == "say \"hi\"", "quote is not unescaped");
+  Check(names.at(4).AsString() == "bell\x07", "\\u escape is not unescaped");
+
+  const string printed = PrintToString(document);
+  Check(printed == R"({"name \"quoted\"": ["A\\B", "1\\x", "say \"hi\"", "tab\there", "bell\u0007"]})",
+        "unexpected printed text: " + printed);
+
+  istringstream reprinted_input(printed);
+  Check(PrintToString(Json::Load(reprinted_input)) == printed, "printed text does not round-trip");
+}
+
+}
+
+int main() {
+  try {
+    TestEscapedNamesRoundTrip();
+  } catch (const exception& e) {
+    cerr << "json_test failed: " << e.what() << endl;
+    return 1;
+  }
+  cerr << "json_test OK" << endl;
+  return 0;
+}
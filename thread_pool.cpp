@@ -0,0 +1,69 @@
+#include "thread_pool.h"
+
+#include <algorithm>
+#include <thread>
+#include <utility>
+
+using namespace std;
+
+ThreadPool::ThreadPool(size_t thread_count)
+  : thread_count_(max<size_t>(thread_count, 1))
+{
+  for (size_t i = 0; i < thread_count_; ++i) {
+    queues_.push_back(make_unique<WorkerQueue>());
+  }
+}
+
+size_t ThreadPool::DefaultThreadCount() {
+  return max<size_t>(thread::hardware_concurrency(), 1);
+}
+
+void ThreadPool::Execute(vector<Task> tasks) {
+  for (size_t i = 0; i < tasks.size(); ++i) {
+    queues_[i % thread_count_]->tasks.push_back(move(tasks[i]));
+  }
+
+  vector<thread> workers;
+  workers.reserve(thread_count_ - 1);
+  for (size_t worker_id = 1; worker_id < thread_count_; ++worker_id) {
+    workers.emplace_back([this, worker_id] { RunWorker(worker_id); });
+  }
+  RunWorker(0);
+
+  for (auto& worker : workers) {
+    worker.join();
+  }
+}
+
+void ThreadPool::RunWorker(size_t worker_id) {
+  while (auto task = PopTask(worker_id)) {
+    (*task)(worker_id);
+  }
+  while (auto task = StealTask(worker_id)) {
+    (*task)(worker_id);
+  }
+}
+
+optional<ThreadPool::Task> ThreadPool::PopTask(size_t worker_id) {
+  auto& queue = *queues_[worker_id];
+  lock_guard<mutex> guard(queue.mutex);
+  if (queue.tasks.empty()) {
+    return nullopt;
+  }
+  Task task = move(queue.tasks.front());
+  queue.tasks.pop_front();
+  return task;
+}
+
+optional<ThreadPool::Task> ThreadPool::StealTask(size_t worker_id) {
+  for (size_t shift = 1; shift < thread_count_; ++shift) {
+    auto& victim = *queues_[(worker_id + shift) % thread_count_];
+    lock_guard<mutex> guard(victim.mutex);
+    if (!victim.tasks.empty()) {
+      Task task = move(victim.tasks.back());
+      victim.tasks.pop_back();
+      return task;
+    }
+  }
+  return nullopt;
+}
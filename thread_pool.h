@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+// Runs a batch of independent tasks on a fixed number of threads. Tasks are
+// dealt round-robin into per-worker queues; a worker takes tasks from the
+// front of its own queue and, once it runs dry, steals from the back of the
+// others, so uneven task costs still keep every core busy.
+class ThreadPool {
+public:
+  using Task = std::function<void(size_t worker_id)>;
+
+  explicit ThreadPool(size_t thread_count);
+
+  size_t ThreadCount() const { return thread_count_; }
+
+  void Execute(std::vector<Task> tasks);
+
+  static size_t DefaultThreadCount();
+
+private:
+  struct WorkerQueue {
+    std::mutex mutex;
+    std::deque<Task> tasks;
+  };
+
+  size_t thread_count_;
+  std::vector<std::unique_ptr<WorkerQueue>> queues_;
+
+  void RunWorker(size_t worker_id);
+  std::optional<Task> PopTask(size_t worker_id);
+  std::optional<Task> StealTask(size_t worker_id);
+};
@@ -1,15 +1,24 @@
 #include "transport_manager.h"
 
+#include "blocked_router.h"
 #include "bus.h"
+#include "dijkstra_router.h"
 #include "graph.h"
+#include "json_api.h"
 #include "map_builder.h"
+#include "perfect_hash.h"
+#include "router.h"
+#include "route_tree_codec.h"
 #include "router.pb.h"
 #include "stop.h"
+#include "thread_pool.h"
 #include "transport_manager_command.h"
 
 #include "transport_catalog.pb.h"
 
+#include <filesystem>
 #include <iterator>
+#include <limits>
 #include <sstream>
 #include <set>
 #include <stdexcept>
@@ -24,6 +33,69 @@
 
 using namespace std;
 
+namespace {
+
+struct RouteRow {
+  size_t from_idx;
+  TransportGuide::RouteTree tree;
+};
+
+// Rough arena footprint of the catalog parts, used to size its first block
+constexpr size_t STOP_BYTES = 256;
+constexpr size_t BUS_BYTES = 256;
+constexpr size_t EDGE_BYTES = 64;
+constexpr size_t PARSED_CATALOG_FACTOR = 4;
+
+// Version 1: rendered responses are escaped, per-stop bus lists and bus
+// statistics are no longer stored
+constexpr uint32_t BASE_FORMAT_VERSION = 1;
+
+RouteRow BuildRouteRow(const Graph::Router<double>& router, size_t stop_count, size_t from_idx) {
+  const auto tree = router.BuildRouteTree(2 * from_idx);
+
+  vector<uint32_t> prev_edges;
+  prev_edges.reserve(tree.size());
+  for (const auto& route : tree) {
+    prev_edges.push_back(route && route->prev_edge ? *route->prev_edge + 1 : 0);
+  }
+  vector<double> weights;
+  weights.reserve(stop_count);
+  for (size_t to_idx = 0; to_idx < stop_count; ++to_idx) {
+    const auto& route = tree[2 * to_idx];
+    weights.push_back(route ? route->weight : 0);
+  }
+
+  return {from_idx, RouteTreeCodec::Encode(prev_edges, weights)};
+}
+
+}
+
+size_t TransportManager::BuildThreadCount() const {
+  return routing_settings_.build_threads ? routing_settings_.build_threads : ThreadPool::DefaultThreadCount();
+}
+
+// A row in memory holds at most a parent edge per vertex and a weight per stop
+// (less once compressed); each worker also keeps a tree node per vertex while
+// building it
+size_t TransportManager::RouteRowBatchSize() const {
+  if (!serialization_settings_.memory_budget_mb) {
+    return max<size_t>(stops_.size(), 1);
+  }
+  const size_t vertex_count = road_graph->GetVertexCount();
+  const size_t row_bytes = vertex_count * sizeof(uint32_t) + stops_.size() * sizeof(double);
+  const size_t worker_bytes = BuildThreadCount() * vertex_count * sizeof(optional<Graph::Router<double>::RouteTreeNode>);
+  const size_t budget_bytes = serialization_settings_.memory_budget_mb << 20;
+  return budget_bytes > worker_bytes + row_bytes ? (budget_bytes - worker_bytes) / row_bytes : 1;
+}
+
+void TransportManager::ResetBase(size_t expected_size) {
+  google::protobuf::ArenaOptions options;
+  options.start_block_size = max(options.start_block_size, expected_size);
+  options.max_block_size = max(options.max_block_size, expected_size);
+  base_arena_ = make_unique<google::protobuf::Arena>(options);
+  base_ = google::protobuf::Arena::CreateMessage<TransportGuide::TransportCatalog>(base_arena_.get());
+}
+
 void TransportManager::InitStop(const string& name) {
   if (!stop_idx_.count(name) || (stop_idx_.count(name) && stops_[stop_idx_[name]].Name() != name)) {
     stops_.emplace_back(name);
@@ -31,13 +103,27 @@ void TransportManager::InitStop(const string& name) {
   }
 }
 
-void TransportManager::AddStop(const string& name, double latitude, double longitude, const unordered_map<string, unsigned int>& distances) {
+optional<size_t> TransportManager::FindStopId(string_view name) const {
+  if (flat_base) {
+    return flat_base->FindStop(name);
+  }
+  const auto stop_id = PerfectHash::Find(base_->stop_index(), name);
+  return stop_id && base_->stops(*stop_id).name() == name ? stop_id : nullopt;
+}
+
+optional<size_t> TransportManager::FindBusId(string_view name) const {
+  const auto bus_id = PerfectHash::Find(base_->bus_index(), name);
+  return bus_id && base_->buses(*bus_id).name() == name ? bus_id : nullopt;
+}
+
+void TransportManager::AddStop(const string& name, double latitude, double longitude, const vector<pair<string_view, unsigned int>>& distances) {
   InitStop(name);
 
   size_t id = stop_idx_[name];
   stops_[id].SetCoordinates(Coordinates{latitude, longitude});
 
-  for (const auto& [stop_name, dist] : distances) {
+  for (const auto& [to, dist] : distances) {
+    const string stop_name{to};
     InitStop(stop_name);
     distances_[id][stop_idx_[stop_name]] = dist;
     if (!distances_[stop_idx_[stop_name]].count(id) || (distances_[stop_idx_[stop_name]].count(id) && distances_[stop_idx_[stop_name]][id] == 0)) {
@@ -79,11 +165,26 @@ std::pair<unsigned int, double> TransportManager::ComputeBusRouteLength(const Ro
 }
 
 StopInfo TransportManager::GetStopInfo(const string& stop_name, int request_id) {
-  if (stop_info.count(stop_name)) {
-    const auto& res = stop_info.at(stop_name)->buses();
+  if (flat_base) {
+    const auto stop_id = flat_base->FindStop(stop_name);
+    if (!stop_id) {
+      return StopInfo{
+        .request_id = request_id,
+        .error_message = "not found",
+      };
+    }
+    const auto& stop = flat_base->GetStop(*stop_id);
+    return StopInfo{
+      .request_id = request_id,
+      .rendered = RenderedResponse{flat_base->GetString(stop.response), stop.request_id_offset},
+    };
+  }
+
+  if (const auto stop_id = FindStopId(stop_name)) {
+    const auto& stop = base_->stops(*stop_id);
     return StopInfo{
-      .buses = vector<string>{begin(res), end(res)},
       .request_id = request_id,
+      .rendered = RenderedResponse{stop.response(), stop.request_id_offset()},
     };
   }
 
@@ -108,14 +209,26 @@ StopInfo TransportManager::GetStopInfo(const string& stop_name, int request_id)
 }
 
 BusInfo TransportManager::GetBusInfo(const RouteNumber& bus_no, int request_id) {
-  if (bus_info.count(bus_no)) {
-    const auto& bus = *bus_info.at(bus_no);
+  if (flat_base) {
+    const auto bus_id = flat_base->FindBus(bus_no);
+    if (!bus_id) {
+      return BusInfo{
+        .request_id = request_id,
+        .error_message = "not found",
+      };
+    }
+    const auto& bus = flat_base->GetBus(*bus_id);
+    return BusInfo {
+      .request_id = request_id,
+      .rendered = RenderedResponse{flat_base->GetString(bus.response), bus.request_id_offset},
+    };
+  }
+
+  if (const auto bus_id = FindBusId(bus_no)) {
+    const auto& bus = base_->buses(*bus_id);
     return BusInfo {
-      .route_length = static_cast<size_t>(bus.route_length()),
       .request_id = request_id,
-      .curvature = bus.curvature(),
-      .stop_count = static_cast<size_t>(bus.stop_count()),
-      .unique_stop_count = static_cast<size_t>(bus.unique_stop_count()),
+      .rendered = RenderedResponse{bus.response(), bus.request_id_offset()},
     };
   }
 
@@ -138,75 +251,349 @@ BusInfo TransportManager::GetBusInfo(const RouteNumber& bus_no, int request_id)
   };
 }
 
-void TransportManager::CreateGraph() {
-  road_graph = make_unique<Graph::DirectedWeightedGraph<double>>(2 * stops_.size());
-
-  for (size_t i = 0; i < stops_.size(); ++i) {
-    road_graph->AddEdge(Graph::Edge<double>{
-        .from = 2 * i,
-        .to = 2 * i + 1,
-        .weight = static_cast<double>(routing_settings_.bus_wait_time),
-    });
-    edge_description.push_back(WaitActivity{
-      .type = "Wait",
-      .time = routing_settings_.bus_wait_time,
-      .stop_name = stops_[i].Name(),
-    });
-  }
+double TransportManager::RideTime(const string& from, const string& to) {
+  return distances_[stop_idx_[from]][stop_idx_[to]] / (routing_settings_.bus_velocity * 1000 / 60);
+}
 
+void TransportManager::AddStopPairEdges() {
+  uint32_t bus_id = 0;
   for (const auto& [bus_no, bus] : buses_) {
     const auto& bus_stops = bus.Stops();
     for (size_t i = 0; i < bus_stops.size(); ++i) {
       double time_sum{0.0};
       unsigned int span_count{0};
       for (size_t j = i + 1; j < bus_stops.size(); ++j) {
-        time_sum += distances_[stop_idx_[bus_stops[j - 1]]][stop_idx_[bus_stops[j]]]
-          / (routing_settings_.bus_velocity * 1000 / 60);
+        time_sum += RideTime(bus_stops[j - 1], bus_stops[j]);
         road_graph->AddEdge(Graph::Edge<double>{
             .from = 2 * stop_idx_[bus_stops[i]] + 1,
             .to = 2 * stop_idx_[bus_stops[j]],
             .weight = time_sum
         });
-        edge_description.push_back(BusActivity{
-          .type = "Bus",
-          .time = time_sum,
-          .bus = bus_no,
+        edge_description.push_back(EdgeActivity{
+          .kind = EdgeActivity::Kind::BUS,
+          .id = bus_id,
           .span_count = ++span_count,
-          .start_stop_idx = i,
+          .start_stop_idx = static_cast<uint32_t>(i),
+          .time = time_sum,
+        });
+      }
+    }
+    ++bus_id;
+  }
+}
+
+// Every stop of every bus gets its own vertex. Boarding and alighting edges
+// are free bus activities spanning no stops, so the consecutive activities of
+// one ride merge into a single one in ExpandRouteItems.
+void TransportManager::AddRouteStopEdges() {
+  Graph::VertexId route_stop = 2 * stops_.size();
+  uint32_t bus_id = 0;
+  for (const auto& [bus_no, bus] : buses_) {
+    const auto& bus_stops = bus.Stops();
+    for (size_t i = 0; i < bus_stops.size(); ++i, ++route_stop) {
+      const size_t stop_id = stop_idx_[bus_stops[i]];
+      if (i + 1 < bus_stops.size()) {
+        road_graph->AddEdge(Graph::Edge<double>{
+            .from = 2 * stop_id + 1,
+            .to = route_stop,
+            .weight = 0,
+        });
+        edge_description.push_back(EdgeActivity{
+          .kind = EdgeActivity::Kind::BUS,
+          .id = bus_id,
+          .span_count = 0,
+          .start_stop_idx = static_cast<uint32_t>(i),
+          .time = 0,
+        });
+
+        const double ride_time = RideTime(bus_stops[i], bus_stops[i + 1]);
+        road_graph->AddEdge(Graph::Edge<double>{
+            .from = route_stop,
+            .to = route_stop + 1,
+            .weight = ride_time,
+        });
+        edge_description.push_back(EdgeActivity{
+          .kind = EdgeActivity::Kind::BUS,
+          .id = bus_id,
+          .span_count = 1,
+          .start_stop_idx = static_cast<uint32_t>(i),
+          .time = ride_time,
+        });
+      }
+      if (i > 0) {
+        road_graph->AddEdge(Graph::Edge<double>{
+            .from = route_stop,
+            .to = 2 * stop_id,
+            .weight = 0,
+        });
+        edge_description.push_back(EdgeActivity{
+          .kind = EdgeActivity::Kind::BUS,
+          .id = bus_id,
+          .span_count = 0,
+          .start_stop_idx = static_cast<uint32_t>(i),
+          .time = 0,
         });
       }
     }
+    ++bus_id;
+  }
+}
+
+void TransportManager::CreateGraph() {
+  size_t vertex_count = 2 * stops_.size();
+  if (routing_settings_.graph_model == GraphModel::ROUTE_STOPS) {
+    for (const auto& [bus_no, bus] : buses_) {
+      vertex_count += bus.Stops().size();
+    }
+  }
+  road_graph = make_unique<Graph::DirectedWeightedGraph<double>>(vertex_count);
+
+  bus_names.reserve(buses_.size());
+  for (const auto& [bus_no, bus] : buses_) {
+    bus_names.push_back(bus_no);
+  }
+
+  vertex_stop.reserve(vertex_count);
+  for (size_t i = 0; i < stops_.size(); ++i) {
+    vertex_stop.insert(end(vertex_stop), 2, i);
+  }
+  if (routing_settings_.graph_model == GraphModel::ROUTE_STOPS) {
+    for (const auto& [bus_no, bus] : buses_) {
+      for (const auto& stop_name : bus.Stops()) {
+        vertex_stop.push_back(stop_idx_[stop_name]);
+      }
+    }
+  }
+
+  for (size_t i = 0; i < stops_.size(); ++i) {
+    road_graph->AddEdge(Graph::Edge<double>{
+        .from = 2 * i,
+        .to = 2 * i + 1,
+        .weight = static_cast<double>(routing_settings_.bus_wait_time),
+    });
+    edge_description.push_back(EdgeActivity{
+      .kind = EdgeActivity::Kind::WAIT,
+      .id = static_cast<uint32_t>(i),
+      .time = static_cast<double>(routing_settings_.bus_wait_time),
+    });
   }
+
+  switch (routing_settings_.graph_model) {
+  case GraphModel::STOP_PAIRS:
+    AddStopPairEdges();
+    break;
+  case GraphModel::ROUTE_STOPS:
+    AddRouteStopEdges();
+    break;
+  }
+
+  road_graph->Freeze();
 }
 
 void TransportManager::CreateRouter() {
+  if (routing_settings_.routing_mode == RoutingMode::RAPTOR) {
+    return;
+  }
   if (!road_graph) {
     CreateGraph();
   }
-  router = make_unique<Graph::Router<double>>(*road_graph);
+  if (routing_settings_.routing_mode == RoutingMode::CONTRACTION_HIERARCHY) {
+    contraction_hierarchy = make_unique<Graph::ContractionHierarchy<double>>(*road_graph);
+    return;
+  }
+  if (routing_settings_.routing_mode == RoutingMode::A_STAR) {
+    landmark_astar = make_unique<Graph::LandmarkAStar<double>>(
+        *road_graph, nullptr,
+        Graph::LandmarkAStar<double>::ChooseLandmarks(*road_graph, routing_settings_.landmark_count));
+    return;
+  }
+  switch (routing_settings_.router_engine) {
+  case RouterEngine::FLOYD_WARSHALL:
+    router = make_unique<Graph::FloydWarshallRouter<double>>(*road_graph);
+    break;
+  case RouterEngine::BLOCKED_FLOYD_WARSHALL:
+    router = make_unique<Graph::BlockedFloydWarshallRouter<double>>(*road_graph, BuildThreadCount());
+    break;
+  case RouterEngine::DIJKSTRA:
+    router = make_unique<Graph::DijkstraRouter<double>>(*road_graph);
+    break;
+  }
+}
+
+variant<WaitActivity, BusActivity> TransportManager::GetEdgeDescription(Graph::EdgeId edge_id) const {
+  if (!edge_description.empty()) {
+    const auto& activity = edge_description[edge_id];
+    if (activity.kind == EdgeActivity::Kind::WAIT) {
+      return WaitActivity{
+        .time = routing_settings_.bus_wait_time,
+        .stop_name = stops_[activity.id].Name(),
+      };
+    }
+    return BusActivity{
+      .time = activity.time,
+      .bus = bus_names[activity.id],
+      .span_count = activity.span_count,
+      .start_stop_idx = activity.start_stop_idx,
+    };
+  }
+
+  if (!flat_base) {
+    const auto& router = base_->router();
+    if (edge_id < static_cast<size_t>(router.wait_activity_size())) {
+      return WaitActivity{
+        .time = routing_settings_.bus_wait_time,
+        .stop_name = base_->stops(router.wait_activity(edge_id).stop_id()).name(),
+      };
+    }
+    const auto& bus = router.bus_activity(edge_id - router.wait_activity_size());
+    return BusActivity{
+      .time = bus.time(),
+      .bus = base_->buses(bus.bus_id()).name(),
+      .span_count = bus.span_count(),
+      .start_stop_idx = bus.start_stop_idx(),
+    };
+  }
+
+  const auto& activity = flat_base->GetActivity(edge_id);
+  if (activity.kind == FlatBase::ActivityKind::WAIT) {
+    return WaitActivity{
+      .time = routing_settings_.bus_wait_time,
+      .stop_name = flat_base->GetString(activity.name),
+    };
+  }
+  return BusActivity{
+    .time = activity.time,
+    .bus = flat_base->GetString(activity.name),
+    .span_count = activity.span_count,
+    .start_stop_idx = activity.start_stop_idx,
+  };
+}
+
+RouteInfo::Route TransportManager::ExpandRouteItems(const vector<Graph::EdgeId>& edges) const {
+  RouteInfo::Route items;
+  items.reserve(edges.size());
+  for (const auto edge_id : edges) {
+    const auto activity = GetEdgeDescription(edge_id);
+    auto* ride = items.empty() ? nullptr : get_if<BusActivity>(&items.back());
+    const auto* ride_part = get_if<BusActivity>(&activity);
+    if (ride && ride_part && ride->bus == ride_part->bus
+        && ride->start_stop_idx + ride->span_count == ride_part->start_stop_idx) {
+      ride->time += ride_part->time;
+      ride->span_count += ride_part->span_count;
+    } else {
+      items.push_back(activity);
+    }
+  }
+  return items;
 }
 
 RouteInfo TransportManager::GetRouteInfo(std::string from, std::string to, int request_id) {
-  if (!(route_infos.count(from) && route_infos.at(from).count(to))) {
+  const auto from_id = FindStopId(from);
+  const auto to_id = FindStopId(to);
+
+  if (raptor_router) {
+    optional<RaptorRouter::Journey> journey;
+    if (from_id && to_id) {
+      journey = raptor_router->FindJourney(*from_id, *to_id);
+    }
+    if (!journey) {
+      return {
+        .request_id = request_id,
+        .error_message = "not found",
+      };
+    }
+
+    RouteInfo::Route items;
+    items.reserve(2 * journey->rides.size());
+    for (const auto& ride : journey->rides) {
+      const auto& bus = base_->buses(ride.bus);
+      items.push_back(WaitActivity{
+        .time = routing_settings_.bus_wait_time,
+        .stop_name = base_->stops(bus.route_stops(ride.board_idx)).name(),
+      });
+      items.push_back(BusActivity{
+        .time = ride.time,
+        .bus = bus.name(),
+        .span_count = static_cast<unsigned int>(ride.alight_idx - ride.board_idx),
+        .start_stop_idx = ride.board_idx,
+      });
+    }
+
     return {
       .request_id = request_id,
-      .error_message = "not found",
+      .total_time = journey->total_time,
+      .items = move(items),
     };
   }
 
-  const auto& route_info = route_infos[from][to];
+  auto point_to_point_route_info = [&](const auto& route) -> RouteInfo {
+    if (!route) {
+      return {
+        .request_id = request_id,
+        .error_message = "not found",
+      };
+    }
+
+    return {
+      .request_id = request_id,
+      .total_time = route->weight,
+      .items = ExpandRouteItems(route->edges),
+    };
+  };
+
+  if (contraction_hierarchy) {
+    optional<Graph::ContractionHierarchy<double>::Route> route;
+    if (from_id && to_id) {
+      route = contraction_hierarchy->FindRoute(2 * *from_id, 2 * *to_id);
+    }
+    return point_to_point_route_info(route);
+  }
+
+  if (landmark_astar) {
+    optional<Graph::LandmarkAStar<double>::Route> route;
+    if (from_id && to_id) {
+      route = landmark_astar->FindRoute(2 * *from_id, 2 * *to_id);
+    }
+    return point_to_point_route_info(route);
+  }
 
-  std::vector<std::variant<WaitActivity, BusActivity>> items;
-  items.reserve(route_info.edge_count);
+  if (!(from_id && to_id)) {
+    return {
+      .request_id = request_id,
+      .error_message = "not found",
+    };
+  }
 
-  for (size_t i = 0; i < route_info.edge_count; ++i) {
-    auto edge_id = expanded_routes_cache.at(route_info.id)[i];
-    items.push_back(edge_description[edge_id]);
+  vector<Graph::EdgeId> edges;
+  double total_time;
+  auto collect_edges = [&](auto prev_edge, auto edge_from) {
+    for (uint32_t edge = prev_edge(2 * *to_id); edge; edge = prev_edge(edge_from(edge - 1))) {
+      edges.push_back(edge - 1);
+    }
+  };
+  if (flat_base) {
+    collect_edges([&](size_t vertex) { return flat_base->RoutePrevEdge(*from_id, vertex); },
+                  [&](size_t edge_id) { return flat_base->EdgeFrom(edge_id); });
+    total_time = flat_base->RouteWeight(*from_id, *to_id);
+  } else {
+    const auto& tree = lazy_route_trees->Get(*from_id);
+    const auto& edge_from = base_->router().edge_from();
+    collect_edges([&](size_t vertex) { return RouteTreeCodec::GetPrevEdge(tree, vertex); },
+                  [&](size_t edge_id) { return edge_from[edge_id]; });
+    total_time = RouteTreeCodec::GetWeight(tree, *to_id);
   }
+  if (edges.empty() && from_id != to_id) {
+    return {
+      .request_id = request_id,
+      .error_message = "not found",
+    };
+  }
+  reverse(begin(edges), end(edges));
+  const auto items = ExpandRouteItems(edges);
 
   return {
     .request_id = request_id,
-    .total_time = route_info.weight,
+    .total_time = total_time,
     .items = items,
     //.svg_map = MapBuilder{render_settings_, stops_, stop_idx_, buses_}.GetRouteMap(items),
   };
@@ -220,124 +607,336 @@ MapDescription TransportManager::GetMap(int request_id) const {
 }
 
 void TransportManager::FillBase() {
+  ResetBase(stops_.size() * STOP_BYTES + buses_.size() * BUS_BYTES + edge_description.size() * EDGE_BYTES);
+
+  base_->set_format_version(BASE_FORMAT_VERSION);
+
   for (const auto& stop : stops_) {
-    auto stop_ptr = base_.add_stops();
+    auto stop_ptr = base_->add_stops();
     stop_ptr->set_name(stop.Name());
-    for (const auto& bus : GetStopInfo(stop.Name(), -1).buses) {
-      stop_ptr->add_buses(bus);
+    if (routing_settings_.routing_mode == RoutingMode::A_STAR) {
+      stop_ptr->set_latitude(stop.StopCoordinates().latitude);
+      stop_ptr->set_longitude(stop.StopCoordinates().longitude);
     }
+    auto [response, request_id_offset] = JsonArgs::RenderStopResponse(GetStopInfo(stop.Name(), 0));
+    stop_ptr->set_response(move(response));
+    stop_ptr->set_request_id_offset(request_id_offset);
   }
 
   for (const auto& p : buses_) {
-    const auto bus_info = GetBusInfo(p.first, -1);
-    auto bus = base_.add_buses();
+    auto bus = base_->add_buses();
     bus->set_name(p.first);
-    bus->set_route_length(bus_info.route_length);
-    bus->set_curvature(bus_info.curvature);
-    bus->set_stop_count(bus_info.stop_count);
-    bus->set_unique_stop_count(bus_info.unique_stop_count);
+    auto [response, request_id_offset] = JsonArgs::RenderBusResponse(GetBusInfo(p.first, 0));
+    bus->set_response(move(response));
+    bus->set_request_id_offset(request_id_offset);
+
+    if (routing_settings_.routing_mode == RoutingMode::RAPTOR) {
+      const auto& bus_stops = p.second.Stops();
+      for (size_t i = 0; i < bus_stops.size(); ++i) {
+        bus->add_route_stops(stop_idx_[bus_stops[i]]);
+        if (i > 0) {
+          bus->add_route_distances(distances_[stop_idx_[bus_stops[i - 1]]][stop_idx_[bus_stops[i]]]);
+        }
+      }
+    }
   }
 
-  auto router_serialized = base_.mutable_router();
+  // Built last, as the queries above must not find names in the catalog yet
+  vector<string_view> stop_names;
+  stop_names.reserve(base_->stops_size());
+  for (const auto& stop : base_->stops()) {
+    stop_names.push_back(stop.name());
+  }
+  *base_->mutable_stop_index() = PerfectHash::Build(stop_names);
+  vector<string_view> bus_names;
+  bus_names.reserve(base_->buses_size());
+  for (const auto& bus : base_->buses()) {
+    bus_names.push_back(bus.name());
+  }
+  *base_->mutable_bus_index() = PerfectHash::Build(bus_names);
+
+  auto router_serialized = base_->mutable_router();
 
   auto settings = router_serialized->mutable_settings();
   settings->set_bus_wait_time(routing_settings_.bus_wait_time);
   settings->set_bus_velocity(routing_settings_.bus_velocity);
+  settings->set_routing_mode(static_cast<TransportGuide::RoutingMode>(routing_settings_.routing_mode));
+  if (routing_settings_.routing_mode == RoutingMode::RAPTOR) {
+    return;
+  }
 
+  router_serialized->mutable_wait_activity()->Reserve(stops_.size());
+  router_serialized->mutable_bus_activity()->Reserve(edge_description.size() - stops_.size());
   for (const auto& activity : edge_description) {
-    if (holds_alternative<WaitActivity>(activity)) {
-      auto wait_activity = get<WaitActivity>(activity);
-      auto wait_serialized = router_serialized->add_wait_activity();
-      wait_serialized->set_stop_name(wait_activity.stop_name);
-    } else if (holds_alternative<BusActivity>(activity)) {
-      auto bus_activity = get<BusActivity>(activity);
-      auto bus_serialized = router_serialized->add_bus_activity();
-      bus_serialized->set_time(bus_activity.time);
-      bus_serialized->set_bus(bus_activity.bus);
-      bus_serialized->set_span_count(bus_activity.span_count);
-      bus_serialized->set_start_stop_idx(bus_activity.start_stop_idx);
+    if (activity.kind == EdgeActivity::Kind::WAIT) {
+      router_serialized->add_wait_activity()->set_stop_id(activity.id);
     } else {
-      throw std::runtime_error("Activity is not supported");
+      auto bus_serialized = router_serialized->add_bus_activity();
+      bus_serialized->set_time(activity.time);
+      bus_serialized->set_bus_id(activity.id);
+      bus_serialized->set_span_count(activity.span_count);
+      bus_serialized->set_start_stop_idx(activity.start_stop_idx);
     }
   }
 
-  for (const auto& from : stops_) {
-    for (const auto& to : stops_) {
-      size_t from_id = 2 * stop_idx_[from.Name()];
-      size_t to_id = 2 * stop_idx_[to.Name()];
+  if (contraction_hierarchy) {
+    auto hierarchy_serialized = router_serialized->mutable_contraction_hierarchy();
+    for (const auto rank : contraction_hierarchy->GetRanks()) {
+      hierarchy_serialized->add_rank(rank);
+    }
+    for (const auto& arc : contraction_hierarchy->GetArcs()) {
+      hierarchy_serialized->add_arc_from(arc.from);
+      hierarchy_serialized->add_arc_to(arc.to);
+      hierarchy_serialized->add_arc_weight(arc.weight);
+    }
+    for (const auto& shortcut : contraction_hierarchy->GetShortcuts()) {
+      hierarchy_serialized->add_shortcut_first(shortcut.first);
+      hierarchy_serialized->add_shortcut_second(shortcut.second);
+    }
+    return;
+  }
+
+  if (landmark_astar) {
+    for (Graph::EdgeId edge_id = 0; edge_id < road_graph->GetEdgeCount(); ++edge_id) {
+      const auto edge = road_graph->GetEdge(edge_id);
+      router_serialized->add_edge_from(edge.from);
+      router_serialized->add_edge_to(edge.to);
+      router_serialized->add_edge_weight(edge.weight);
+    }
+    for (const auto stop_id : vertex_stop) {
+      router_serialized->add_vertex_stop(stop_id);
+    }
+    for (const auto& landmark : landmark_astar->GetLandmarks()) {
+      auto landmark_serialized = router_serialized->add_landmarks();
+      landmark_serialized->set_vertex(landmark.vertex);
+      for (const auto distance : landmark.distances_from) {
+        landmark_serialized->add_distances_from(distance);
+      }
+      for (const auto distance : landmark.distances_to) {
+        landmark_serialized->add_distances_to(distance);
+      }
+    }
+    return;
+  }
 
-      if (auto route_info_opt = router->BuildRoute(from_id, to_id); route_info_opt) {
-        auto route_info = route_info_opt.value();
-        auto route_info_serialized = router_serialized->add_route_info();
-        route_info_serialized->set_id(route_info.id);
-        route_info_serialized->set_weight(route_info.weight);
-        route_info_serialized->set_edge_count(route_info.edge_count);
-        route_info_serialized->set_vertex_from(from.Name());
-        route_info_serialized->set_vertex_to(to.Name());
+  router_serialized->mutable_edge_from()->Reserve(road_graph->GetEdgeCount());
+  router_serialized->mutable_edge_to()->Reserve(road_graph->GetEdgeCount());
+  for (Graph::EdgeId edge_id = 0; edge_id < road_graph->GetEdgeCount(); ++edge_id) {
+    const auto edge = road_graph->GetEdge(edge_id);
+    router_serialized->add_edge_from(edge.from);
+    router_serialized->add_edge_to(edge.to);
+  }
 
-        for (size_t i = 0; i < route_info.edge_count; ++i) {
-          route_info_serialized->add_expanded_route(router->GetRouteEdge(route_info.id, i));
+  // Rows are built per source on a work-stealing pool, each worker keeping its
+  // own buffer. Merging rows by source index makes the base identical to the
+  // one built by a single thread. Under a memory budget rows are built in
+  // batches of sources and every merged batch is spilled to disk. Given the
+  // base of an earlier input, each worker reads the previous tree of its
+  // source, the reads taking turns on the file, and rebuilds the tree only if
+  // the input changes may have affected it; a previous tree is held only
+  // while its source is being handled.
+  const size_t batch_size = RouteRowBatchSize();
+  if (batch_size < stops_.size()) {
+    route_tree_spill = make_unique<RouteTreeSpill>(serialization_settings_.file + ".rows");
+  }
+  const auto reuse = serialization_settings_.previous_file.empty()
+      ? nullptr
+      : RouteTreeReuse::Open(serialization_settings_.previous_file, routing_settings_, stop_idx_, *road_graph,
+                             edge_description, bus_names);
+
+  ThreadPool pool{BuildThreadCount()};
+  for (size_t batch_begin = 0; batch_begin < stops_.size(); batch_begin += batch_size) {
+    const size_t batch_end = min(stops_.size(), batch_begin + batch_size);
+    vector<vector<RouteRow>> worker_rows(pool.ThreadCount());
+
+    vector<ThreadPool::Task> tasks;
+    tasks.reserve(batch_end - batch_begin);
+    for (size_t from_idx = batch_begin; from_idx < batch_end; ++from_idx) {
+      tasks.push_back([this, &worker_rows, &reuse, from_idx](size_t worker_id) {
+        optional<TransportGuide::RouteTree> tree;
+        if (reuse) {
+          if (const auto previous = reuse->ReadTree(from_idx)) {
+            tree = reuse->Reuse(from_idx, *previous);
+          }
         }
+        worker_rows[worker_id].push_back(tree
+            ? RouteRow{from_idx, move(*tree)}
+            : BuildRouteRow(*router, stops_.size(), from_idx));
+      });
+    }
+    pool.Execute(move(tasks));
+
+    vector<RouteRow*> rows(batch_end - batch_begin);
+    for (auto& buffer : worker_rows) {
+      for (auto& row : buffer) {
+        rows[row.from_idx - batch_begin] = &row;
       }
+    }
 
+    for (auto row : rows) {
+      if (route_tree_spill) {
+        route_tree_spill->Append(row->tree);
+      } else {
+        route_trees.push_back(move(row->tree));
+      }
     }
   }
 }
 
-void TransportManager::Serialize() const {
-  ofstream out_file(serialization_settings_.file);
-  base_.SerializeToOstream(&out_file);
+vector<uint32_t> TransportManager::RouteTreeSizes() const {
+  if (route_tree_spill) {
+    return route_tree_spill->TreeSizes();
+  }
+  vector<uint32_t> tree_sizes;
+  tree_sizes.reserve(route_trees.size());
+  for (const auto& tree : route_trees) {
+    tree_sizes.push_back(tree.ByteSizeLong());
+  }
+  return tree_sizes;
 }
 
-void TransportManager::Deserialize() {
-  ifstream in_file(serialization_settings_.file);
+RouteTreeSource TransportManager::RouteTrees() const {
+  if (route_tree_spill) {
+    return [this](const auto& visitor) { route_tree_spill->ForEach(visitor); };
+  }
+  return [this](const auto& visitor) {
+    for (const auto& tree : route_trees) {
+      visitor(tree);
+    }
+  };
+}
 
-  base_.Clear();
-  base_.ParseFromIstream(&in_file);
+void TransportManager::Serialize() const {
+  ofstream out_file(serialization_settings_.file, ios::binary);
+  switch (serialization_settings_.format) {
+  case BaseFormat::PROTOBUF:
+    if (routing_settings_.routing_mode == RoutingMode::ALL_PAIRS) {
+      LazyRouteTrees::WriteBase(*base_, RouteTreeSizes(), RouteTrees(), out_file);
+    } else {
+      base_->SerializeToOstream(&out_file);
+    }
+    break;
+  case BaseFormat::FLAT:
+    FlatBase::Write(*base_, road_graph ? road_graph->GetVertexCount() : 0, RouteTrees(), out_file);
+    break;
+  }
+}
 
-  for (size_t i = 0; i < base_.stops_size(); ++i) {
-    stop_info[base_.stops(i).name()] = &base_.stops(i);
+void TransportManager::Deserialize() {
+  if (FlatBase::IsFlatBase(serialization_settings_.file)) {
+    flat_base = make_unique<FlatBase>(serialization_settings_.file);
+    routing_settings_ = RoutingSettings{
+      flat_base->BusWaitTime(),
+      flat_base->BusVelocity(),
+    };
+    return;
   }
 
-  for (const auto& bus : base_.buses()) {
-    bus_info[bus.name()] = &bus;
+  // A parsed catalog takes a few times its serialized size; pages of the
+  // first block that stay unused are never touched
+  auto catalog_size = LazyRouteTrees::CatalogSize(serialization_settings_.file);
+  if (!catalog_size) {
+    error_code file_size_error;
+    const auto file_size = filesystem::file_size(serialization_settings_.file, file_size_error);
+    catalog_size = file_size_error ? 0 : file_size;
+  }
+  ResetBase(*catalog_size * PARSED_CATALOG_FACTOR);
+  lazy_route_trees = LazyRouteTrees::Open(serialization_settings_.file, serialization_settings_.route_cache_size, *base_);
+  if (!lazy_route_trees) {
+    ifstream in_file(serialization_settings_.file);
+    base_->ParseFromIstream(&in_file);
+  }
+  if (base_->format_version() != BASE_FORMAT_VERSION) {
+    throw runtime_error("base file " + serialization_settings_.file + " was written by an incompatible make_base, rebuild it");
   }
 
   routing_settings_ = RoutingSettings{
-    base_.router().settings().bus_wait_time(),
-    base_.router().settings().bus_velocity(),
+    base_->router().settings().bus_wait_time(),
+    base_->router().settings().bus_velocity(),
   };
+  routing_settings_.routing_mode = static_cast<RoutingMode>(base_->router().settings().routing_mode());
+
+  if (routing_settings_.routing_mode == RoutingMode::RAPTOR) {
+    vector<RaptorRouter::BusLine> bus_lines;
+    bus_lines.reserve(base_->buses_size());
+    for (const auto& bus : base_->buses()) {
+      RaptorRouter::BusLine line;
+      line.stops.assign(begin(bus.route_stops()), end(bus.route_stops()));
+      line.ride_times.reserve(bus.route_distances_size());
+      for (const auto distance : bus.route_distances()) {
+        line.ride_times.push_back(distance / (routing_settings_.bus_velocity * 1000 / 60));
+      }
+      bus_lines.push_back(move(line));
+    }
+    raptor_router = make_unique<RaptorRouter>(base_->stops_size(), move(bus_lines), routing_settings_.bus_wait_time);
+  }
 
-  for (const auto& route_info_serialized : base_.router().route_info()) {
-    route_infos[route_info_serialized.vertex_from()][route_info_serialized.vertex_to()] = {
-      route_info_serialized.id(),
-      route_info_serialized.weight(),
-      route_info_serialized.edge_count(),
-    };
+  if (routing_settings_.routing_mode == RoutingMode::A_STAR) {
+    const auto& router_serialized = base_->router();
+    road_graph = make_unique<Graph::DirectedWeightedGraph<double>>(router_serialized.vertex_stop_size());
+    for (int i = 0; i < router_serialized.edge_from_size(); ++i) {
+      road_graph->AddEdge({router_serialized.edge_from(i), router_serialized.edge_to(i), router_serialized.edge_weight(i)});
+    }
+    road_graph->Freeze();
 
-  expanded_routes_cache[route_info_serialized.id()].reserve(route_info_serialized.expanded_route_size());
-    for (const auto& edge_id : route_info_serialized.expanded_route()) {
-      expanded_routes_cache[route_info_serialized.id()].push_back(edge_id);
+    vertex_stop.assign(begin(router_serialized.vertex_stop()), end(router_serialized.vertex_stop()));
+    vector<Coordinates> stop_coordinates;
+    stop_coordinates.reserve(base_->stops_size());
+    for (const auto& stop : base_->stops()) {
+      stop_coordinates.push_back({stop.latitude(), stop.longitude()});
     }
-  }
 
-  edge_description.reserve(base_.router().wait_activity_size() + base_.router().bus_activity_size());
-  for (size_t i = 0; i < base_.router().wait_activity_size(); ++i) {
-    edge_description.push_back(WaitActivity{
-      .type = "Wait",
-      .time = routing_settings_.bus_wait_time,
-      .stop_name = base_.router().wait_activity(i).stop_name(),
-    });
+    // No ride is faster than its straight-line distance at the top speed
+    // observed over all edges, so that speed bounds the remaining time
+    double time_per_meter = numeric_limits<double>::infinity();
+    for (int i = 0; i < router_serialized.edge_from_size(); ++i) {
+      const double distance = Coordinates::Distance(stop_coordinates[vertex_stop[router_serialized.edge_from(i)]],
+                                                    stop_coordinates[vertex_stop[router_serialized.edge_to(i)]]);
+      if (distance > 0) {
+        time_per_meter = min(time_per_meter, router_serialized.edge_weight(i) / distance);
+      }
+    }
+    if (time_per_meter == numeric_limits<double>::infinity()) {
+      time_per_meter = 0;
+    }
+
+    vector<Graph::LandmarkAStar<double>::Landmark> landmarks;
+    landmarks.reserve(router_serialized.landmarks_size());
+    for (const auto& landmark : router_serialized.landmarks()) {
+      landmarks.push_back({
+        landmark.vertex(),
+        {begin(landmark.distances_from()), end(landmark.distances_from())},
+        {begin(landmark.distances_to()), end(landmark.distances_to())},
+      });
+    }
+
+    landmark_astar = make_unique<Graph::LandmarkAStar<double>>(
+        *road_graph,
+        [this, stop_coordinates = move(stop_coordinates), time_per_meter](Graph::VertexId from, Graph::VertexId to) {
+          const double distance = Coordinates::Distance(stop_coordinates[vertex_stop[from]], stop_coordinates[vertex_stop[to]]);
+          return distance > 0 ? time_per_meter * distance : 0;
+        },
+        move(landmarks));
   }
 
-  for (size_t i = 0; i < base_.router().bus_activity_size(); ++i) {
-    const auto& bus = base_.router().bus_activity(i);
-    edge_description.push_back(BusActivity{
-      .type = "Bus",
-      .time = bus.time(),
-      .bus = bus.bus(),
-      .span_count = bus.span_count(),
-      .start_stop_idx = bus.start_stop_idx(),
-    });
+  if (routing_settings_.routing_mode == RoutingMode::CONTRACTION_HIERARCHY) {
+    const auto& hierarchy_serialized = base_->router().contraction_hierarchy();
+    vector<Graph::ContractionHierarchy<double>::Arc> arcs;
+    arcs.reserve(hierarchy_serialized.arc_from_size());
+    for (int i = 0; i < hierarchy_serialized.arc_from_size(); ++i) {
+      arcs.push_back({
+        hierarchy_serialized.arc_from(i),
+        hierarchy_serialized.arc_to(i),
+        hierarchy_serialized.arc_weight(i),
+      });
+    }
+    vector<Graph::ContractionHierarchy<double>::Shortcut> shortcuts;
+    shortcuts.reserve(hierarchy_serialized.shortcut_first_size());
+    for (int i = 0; i < hierarchy_serialized.shortcut_first_size(); ++i) {
+      shortcuts.push_back({hierarchy_serialized.shortcut_first(i), hierarchy_serialized.shortcut_second(i)});
+    }
+    contraction_hierarchy = make_unique<Graph::ContractionHierarchy<double>>(
+        vector<Graph::CompactId>{begin(hierarchy_serialized.rank()), end(hierarchy_serialized.rank())},
+        move(arcs), move(shortcuts));
   }
 }
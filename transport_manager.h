@@ -3,16 +3,26 @@
 #include "stop.h"
 #include "bus.h"
 #include "transport_manager_command.h"
+#include "contraction_hierarchy.h"
+#include "flat_base.h"
 #include "graph.h"
-#include "router.h"
+#include "landmark_astar.h"
+#include "lazy_route_trees.h"
+#include "router_interface.h"
 #include "map_builder.h"
+#include "raptor_router.h"
+#include "route_tree_reuse.h"
+#include "route_tree_spill.h"
 
 #include "transport_catalog.pb.h"
 
+#include <google/protobuf/arena.h>
+
 #include <string_view>
 #include <variant>
 #include <vector>
 #include <map>
+#include <optional>
 #include <unordered_map>
 #include <memory>
 #include <utility>
@@ -26,9 +36,17 @@ public:
     , render_settings_(std::move(render_settings))
     , serialization_settings_(std::move(serialization_settings))
   {
+    ResetBase(0);
   }
+  TransportManager() : TransportManager(RoutingSettings{}, RenderSettings{}, SerializationSettings{}) {}
+
+  // Settings may come after base requests in the input, but are only used
+  // once all of them are added
+  void SetRoutingSettings(RoutingSettings routing_settings) { routing_settings_ = std::move(routing_settings); }
+  void SetRenderSettings(RenderSettings render_settings) { render_settings_ = std::move(render_settings); }
+  void SetSerializationSettings(SerializationSettings serialization_settings) { serialization_settings_ = std::move(serialization_settings); }
 
-  void AddStop(const std::string& name, double latitude, double longitude, const std::unordered_map<std::string, unsigned int>& distances);
+  void AddStop(const std::string& name, double latitude, double longitude, const std::vector<std::pair<std::string_view, unsigned int>>& distances);
   void AddBus(const RouteNumber& route_number, const std::vector<std::string>& stop_names, bool cyclic);
 
   std::pair<unsigned int, double> ComputeBusRouteLength(const RouteNumber& route_number);
@@ -54,17 +72,39 @@ private:
   std::unordered_map<size_t, std::unordered_map<size_t, unsigned int>> distances_;
   std::map<RouteNumber, BusRoute> buses_;
 
-  TransportGuide::TransportCatalog base_;
-  std::unordered_map<std::string, const TransportGuide::Stop*> stop_info;
-  std::unordered_map<std::string, const TransportGuide::Bus*> bus_info;
-
-  std::unordered_map<std::string, std::unordered_map<std::string, Graph::Router<double>::RouteInfo>> route_infos;
-  std::unordered_map<Graph::Router<double>::RouteId, Graph::Router<double>::ExpandedRoute> expanded_routes_cache;
+  // The catalog and all of its messages live on the arena and are freed
+  // together with it
+  std::unique_ptr<google::protobuf::Arena> base_arena_;
+  TransportGuide::TransportCatalog* base_;
+  std::unique_ptr<FlatBase> flat_base{nullptr};
+  std::vector<TransportGuide::RouteTree> route_trees;
+  std::unique_ptr<RouteTreeSpill> route_tree_spill{nullptr};
+  std::unique_ptr<LazyRouteTrees> lazy_route_trees{nullptr};
 
   std::unique_ptr<Graph::DirectedWeightedGraph<double>> road_graph{nullptr};
   std::unique_ptr<Graph::Router<double>> router{nullptr};
-  std::vector<std::variant<WaitActivity, BusActivity>> edge_description;
-
+  std::unique_ptr<Graph::ContractionHierarchy<double>> contraction_hierarchy{nullptr};
+  std::unique_ptr<RaptorRouter> raptor_router{nullptr};
+  std::unique_ptr<Graph::LandmarkAStar<double>> landmark_astar{nullptr};
+  std::vector<size_t> vertex_stop;
+  std::vector<EdgeActivity> edge_description;
+  std::vector<std::string_view> bus_names; // by catalog index, owned by buses_
+
+  // Replaces the catalog with an empty one on an arena whose first block
+  // holds expected_size bytes
+  void ResetBase(size_t expected_size);
   void InitStop(const std::string& name);
+  // Catalog index of the named stop or bus in a loaded base
+  std::optional<size_t> FindStopId(std::string_view name) const;
+  std::optional<size_t> FindBusId(std::string_view name) const;
+  double RideTime(const std::string& from, const std::string& to);
+  void AddStopPairEdges();
+  void AddRouteStopEdges();
+  std::variant<WaitActivity, BusActivity> GetEdgeDescription(Graph::EdgeId edge_id) const;
+  RouteInfo::Route ExpandRouteItems(const std::vector<Graph::EdgeId>& edges) const;
+  size_t BuildThreadCount() const;
+  size_t RouteRowBatchSize() const;
+  std::vector<uint32_t> RouteTreeSizes() const;
+  RouteTreeSource RouteTrees() const;
 };
 
@@ -3,8 +3,10 @@
 #include "svg.h"
 
 #include <algorithm>
+#include <cstdint>
 #include <limits>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
 #include <limits>
@@ -13,9 +15,62 @@
 #include <variant>
 #include <map>
 
+// How make_base computes the shortest path trees it stores. All engines find
+// routes of the same total time, but when several routes tie, Dijkstra may
+// return a different one than Floyd-Warshall, so the items of a Route
+// response can differ between engines.
+enum class RouterEngine {
+  FLOYD_WARSHALL,
+  BLOCKED_FLOYD_WARSHALL,
+  DIJKSTRA,
+};
+
+const std::map<std::string, RouterEngine> ROUTER_ENGINES = {
+  { "floyd_warshall", RouterEngine::FLOYD_WARSHALL },
+  { "blocked_floyd_warshall", RouterEngine::BLOCKED_FLOYD_WARSHALL },
+  { "dijkstra", RouterEngine::DIJKSTRA },
+};
+
+// How process_requests answers Route requests: from routes precomputed for
+// all pairs of stops, by searching the base's contraction hierarchy, by
+// scanning the bus stop sequences round by round or by an A* search directed
+// by stop coordinates and landmarks
+enum class RoutingMode {
+  ALL_PAIRS,
+  CONTRACTION_HIERARCHY,
+  RAPTOR,
+  A_STAR,
+};
+
+const std::map<std::string, RoutingMode> ROUTING_MODES = {
+  { "all_pairs", RoutingMode::ALL_PAIRS },
+  { "contraction_hierarchy", RoutingMode::CONTRACTION_HIERARCHY },
+  { "raptor", RoutingMode::RAPTOR },
+  { "a_star", RoutingMode::A_STAR },
+};
+
+// How buses are put into the routing graph: an edge from every stop of a bus
+// to every later stop, or a vertex per stop of every bus with edges riding
+// to the next stop and boarding and alighting at a stop, which is linear in
+// the route length
+enum class GraphModel {
+  STOP_PAIRS,
+  ROUTE_STOPS,
+};
+
+const std::map<std::string, GraphModel> GRAPH_MODELS = {
+  { "stop_pairs", GraphModel::STOP_PAIRS },
+  { "route_stops", GraphModel::ROUTE_STOPS },
+};
+
 struct RoutingSettings {
   unsigned int bus_wait_time;
   double bus_velocity;
+  RouterEngine router_engine = RouterEngine::DIJKSTRA;
+  unsigned int build_threads = 0; // 0 stands for all available cores
+  RoutingMode routing_mode = RoutingMode::ALL_PAIRS;
+  GraphModel graph_model = GraphModel::STOP_PAIRS;
+  unsigned int landmark_count = 8;
 };
 
 enum class MapLayer {
@@ -49,49 +104,23 @@ struct RenderSettings {
   double outer_margin;
 };
 
-struct SerializationSettings {
-  std::string file;
- };
-
-struct NewStopCommand {
-public:
-  NewStopCommand(std::string name, double latitude, double longitude, std::unordered_map<std::string, unsigned int> distances)
-    : name_(move(name))
-    , latitude_(latitude)
-    , longitude_(longitude)
-    , distances_(move(distances))
-  {
-  }
-
-  std::string Name() const { return name_; }
-  double Latitude() const { return latitude_; }
-  double Longitude() const { return longitude_; }
-  const auto& Distances() const { return distances_; }
-
-private:
-  std::string name_;
-  double latitude_;
-  double longitude_;
-  std::unordered_map<std::string, unsigned int> distances_;
+// Protobuf bases are parsed on load, flat ones are mapped into memory as is
+enum class BaseFormat {
+  PROTOBUF,
+  FLAT,
 };
 
-struct NewBusCommand {
-public:
-  NewBusCommand(std::string name, std::vector<std::string> stops, bool is_cyclic)
-    : name_(move(name))
-    , stops_(move(stops))
-    , cyclic_(is_cyclic)
-  {
-  }
-
-  std::string Name() const { return name_; }
-  std::vector<std::string> Stops() const { return stops_; }
-  bool IsCyclic() const { return cyclic_; }
+const std::map<std::string, BaseFormat> BASE_FORMATS = {
+  { "protobuf", BaseFormat::PROTOBUF },
+  { "flat", BaseFormat::FLAT },
+};
 
-private:
-  std::string name_;
-  std::vector<std::string> stops_;
-  bool cyclic_;
+struct SerializationSettings {
+  std::string file;
+  BaseFormat format = BaseFormat::PROTOBUF;
+  size_t memory_budget_mb = 0; // 0 keeps all route rows in memory
+  size_t route_cache_size = 1024; // route trees kept decoded by process_requests
+  std::string previous_file; // base of an earlier input to reuse route trees from, if set
 };
 
 struct OutCommandBase {
@@ -152,21 +181,20 @@ public:
   MapCommand(int request_id) : OutCommandBase(request_id) {}
 };
 
-using InCommand = std::variant<NewStopCommand, NewBusCommand>;
 using OutCommand = std::variant<StopDescriptionCommand, BusDescriptionCommand, RouteCommand, MapCommand>;
 
-struct TransportManagerCommands {
-  std::vector<InCommand> input_commands;
-  std::vector<OutCommand> output_commands;
-  RoutingSettings routing_settings = {}; // TODO: remove default initialization
-  RenderSettings render_settings = {}; // TODO: remove default initialization
-  SerializationSettings serialization_settings;
+// Stop or Bus response rendered by make_base; the request id goes at
+// request_id_offset of body
+struct RenderedResponse {
+  std::string_view body;
+  size_t request_id_offset;
 };
 
 struct StopInfo {
   std::vector<std::string> buses;
   int request_id;
   std::optional<std::string> error_message;
+  std::optional<RenderedResponse> rendered; // replaces buses if set
 };
 
 struct BusInfo {
@@ -176,22 +204,37 @@ struct BusInfo {
   size_t stop_count;
   size_t unique_stop_count;
   std::optional<std::string> error_message;
+  std::optional<RenderedResponse> rendered; // replaces the statistics if set
 };
 
+// Route items refer to names owned by the catalog or the base they come from
 struct WaitActivity {
-  std::string type;
   unsigned int time;
-  std::string stop_name;
+  std::string_view stop_name;
 };
 
 struct BusActivity {
-  std::string type;
   double time;
-  std::string bus;
+  std::string_view bus;
   unsigned int span_count;
   size_t start_stop_idx;
 };
 
+// Description of a graph edge as make_base keeps it: a wait at a stop or a
+// ride of a bus, given by its catalog index
+struct EdgeActivity {
+  enum class Kind : uint32_t {
+    WAIT,
+    BUS,
+  };
+
+  Kind kind;
+  uint32_t id;
+  uint32_t span_count;
+  uint32_t start_stop_idx;
+  double time;
+};
+
 struct RouteInfo {
   using Route = std::vector<std::variant<WaitActivity, BusActivity>>;
 